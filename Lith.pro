@@ -7,43 +7,10 @@ QT += qml quick widgets multimedia quickcontrols2 xml gui-private websockets
 
 CONFIG += c++17
 
-HEADERS += \
-    src/clipboardproxy.h \
-    src/datamodel.h \
-    src/lith.h \
-    src/protocol.h \
-    src/qmlobjectlist.h \
-    src/settings.h \
-    src/uploader.h \
-    src/util/formattedstring.h \
-    src/util/messagelistfilter.h \
-    src/util/nicklistfilter.h \
-    src/weechat.h \
-    src/common.h \
-    src/windowhelper.h \
-    src/util/colortheme.h \
-    src/util/sockethelper.h
+include(src/src.pri)
 
 SOURCES += \
-    src/lith.cpp \
-    src/main.cpp \
-    src/clipboardproxy.cpp \
-    src/datamodel.cpp \
-    src/protocol.cpp \
-    src/qmlobjectlist.cpp \
-    src/settings.cpp \
-    src/uploader.cpp \
-    src/util/formattedstring.cpp \
-    src/util/messagelistfilter.cpp \
-    src/util/nicklistfilter.cpp \
-    src/weechat.cpp \
-    src/windowhelper.cpp \
-    src/util/colortheme.cpp \
-    src/util/sockethelper.cpp
-
-
-INCLUDEPATH += \
-    src
+    src/main.cpp
 
 RESOURCES += ui/ui.qrc assets/assets.qrc
 
@@ -27,10 +27,13 @@
 #include <QTextDocumentFragment>
 #include <QXmlStreamReader>
 #include <QDomDocument>
+#include <QTimer>
+
+#include <algorithm>
 
 Buffer::Buffer(Lith *parent, pointer_t pointer)
     : QObject(parent)
-    , m_lines(QmlObjectList::create<BufferLine>(this))
+    , m_lines(new LineModel(this))
     , m_nicks(QmlObjectList::create<Nick>(this))
     , m_proxyLinesFiltered(new MessageFilterList(this, m_lines))
     , m_ptr(pointer)
@@ -47,12 +50,86 @@ Lith *Buffer::lith() {
     return qobject_cast<Lith*>(parent());
 }
 
-void Buffer::prependLine(BufferLine *line) {
-    m_lines->prepend(line);
+pointer_t Buffer::ptrGet() const {
+    return m_ptr;
+}
+
+void Buffer::ptrSet(pointer_t ptr) {
+    m_ptr = ptr;
+}
+
+void Buffer::prependLine(BufferLine &&line) {
+    if (m_pendingLines.isEmpty())
+        QTimer::singleShot(c_lineBatchInterval, this, &Buffer::flushPendingLines);
+    m_pendingLinePtrs.insert(line.ptrGet());
+    m_pendingLines.append(std::move(line));
+}
+
+void Buffer::flushPendingLines() {
+    if (m_pendingLines.isEmpty())
+        return;
+    std::reverse(m_pendingLines.begin(), m_pendingLines.end());
+    m_lines->prepend(std::move(m_pendingLines));
+    m_pendingLines.clear();
+    m_pendingLinePtrs.clear();
+}
+
+void Buffer::appendLine(BufferLine &&line) {
+    m_lines->append(std::move(line));
+}
+
+void Buffer::insertMissedLines(pointer_t newerThan, QList<BufferLine> &&lines) {
+    // lines that arrived since the reconnect are newer, they have to stay above
+    flushPendingLines();
+    auto index = m_lines->indexOf(newerThan);
+    // without the line, everything that's left is newer, eviction and clearing take the oldest lines first
+    if (index < 0)
+        index = m_lines->count();
+    m_lines->insert(index, std::move(lines));
+}
+
+pointer_t Buffer::newestLinePtr() const {
+    if (!m_pendingLines.isEmpty())
+        return m_pendingLines.last().ptrGet();
+    if (m_lines->count() > 0)
+        return m_lines->at(0).ptrGet();
+    return 0;
+}
+
+bool Buffer::hasLine(pointer_t ptr) const {
+    return m_pendingLinePtrs.contains(ptr) || m_lines->indexOf(ptr) >= 0;
+}
+
+void Buffer::evictOldestLines(int count) {
+    count = qMin(count, m_lines->count());
+    if (count <= 0)
+        return;
+    m_lines->removeRows(m_lines->count() - count, count);
+    // scrolling back has to be able to get them again
+    m_lastRequestedCount = 0;
+}
+
+qint64 Buffer::memoryUsageGet() const {
+    return m_memoryUsage;
 }
 
-void Buffer::appendLine(BufferLine *line) {
-    m_lines->append(line);
+void Buffer::updateMemoryUsage() {
+    qint64 usage = sizeof(Buffer);
+    for (int i = 0; i < m_lines->count(); i++)
+        usage += m_lines->at(i).memoryUsage();
+    for (const auto &i : m_pendingLines)
+        usage += i.memoryUsage();
+    if (m_memoryUsage != usage) {
+        m_memoryUsage = usage;
+        emit memoryUsageChanged();
+    }
+}
+
+void Buffer::clearLines() {
+    m_pendingLines.clear();
+    m_pendingLinePtrs.clear();
+    m_lines->clear();
+    m_lastRequestedCount = 0;
 }
 
 FormattedString Buffer::titleGet() const {
@@ -70,7 +147,7 @@ bool Buffer::isAfterInitialFetch() {
     return m_afterInitialFetch;
 }
 
-QmlObjectList *Buffer::lines() {
+LineModel *Buffer::lines() {
     return m_lines;
 }
 
@@ -79,42 +156,73 @@ QmlObjectList *Buffer::nicks() {
 }
 
 Nick *Buffer::getNick(pointer_t ptr) {
-    for (int i = 0; i < m_nicks->count(); i++) {
-        auto n = m_nicks->get<Nick>(i);
-        if (n && n->ptrGet() == ptr) {
-            return n;
-        }
-    }
-    return nullptr;
-
-    /*
-    auto nick = new Nick(this);
-    m_nicks.append(nick);
-    nick->ptrSet(ptr);
-    emit nicksChanged();
-    return nick;
-    */
+    return m_nickIndex.value(ptr, nullptr);
 }
 
 void Buffer::addNick(pointer_t ptr, Nick *nick) {
+    // the old one would stay in the list without a way to get to it
+    removeNick(ptr);
     nick->ptrSet(ptr);
+    m_nickIndex.insert(ptr, nick);
+    if (m_nickUpdates > 0) {
+        m_addedNicks.append(nick);
+        m_nicksDirty = true;
+        return;
+    }
     m_nicks->append(nick);
     emit nicksChanged();
 }
 
 void Buffer::removeNick(pointer_t ptr) {
-    for (int i = 0; i < m_nicks->count(); i++) {
-        auto n = m_nicks->get<Nick>(i);
-        if (n && n->ptrGet() == ptr) {
-            m_nicks->removeRow(i);
-            emit nicksChanged();
-            break;
-        }
+    auto nick = m_nickIndex.take(ptr);
+    if (!nick)
+        return;
+    if (m_nickUpdates > 0) {
+        // it may have been added in the same update, then it's not in the list yet
+        if (m_addedNicks.removeOne(nick))
+            delete nick;
+        else
+            m_removedNicks.insert(nick);
+        m_nicksDirty = true;
+        return;
     }
+    m_nicks->removeItem(nick);
+    emit nicksChanged();
 }
 
 void Buffer::clearNicks() {
+    m_nickIndex.clear();
+    qDeleteAll(m_addedNicks);
+    m_addedNicks.clear();
+    m_removedNicks.clear();
     m_nicks->clear();
+    if (m_nickUpdates > 0)
+        m_nicksDirty = true;
+    else
+        emit nicksChanged();
+}
+
+void Buffer::beginNickUpdate() {
+    m_nickUpdates++;
+}
+
+void Buffer::endNickUpdate() {
+    if (m_nickUpdates <= 0 || --m_nickUpdates > 0 || !m_nicksDirty)
+        return;
+    // from the end so the rows still to be checked don't move, neighbours go away as a single range
+    for (int i = m_nicks->count() - 1; i >= 0 && !m_removedNicks.isEmpty(); i--) {
+        if (!m_removedNicks.remove(m_nicks->get<QObject>(i)))
+            continue;
+        int first = i;
+        while (first > 0 && m_removedNicks.remove(m_nicks->get<QObject>(first - 1)))
+            first--;
+        m_nicks->removeRows(first, i - first + 1);
+        i = first;
+    }
+    m_removedNicks.clear();
+    m_nicks->insert(m_nicks->count(), m_addedNicks);
+    m_addedNicks.clear();
+    m_nicksDirty = false;
     emit nicksChanged();
 }
 
@@ -190,96 +298,89 @@ MessageFilterList *Buffer::lines_filtered() {
 }
 
 bool Buffer::input(const QString &data) {
-    if (Lith::instance()->statusGet() == Lith::CONNECTED) {
-        bool success = false;
-        QList<bool> success_list;
+    return sendInput(data, true);
+}
 
-        auto data_split = data.split(QRegularExpression("\n|\r\n|\r"));
+bool Buffer::sendInput(const QString &data, bool fromUser) {
+    if (Lith::instance()->statusGet() != Lith::CONNECTED)
+        return false;
+    auto lines = data.split(QRegularExpression("\n|\r\n|\r"));
+    // doesn't wait for the weechat thread, onInputSent says how it went
+    if (!QMetaObject::invokeMethod(Lith::instance()->weechat(), "input", Qt::QueuedConnection, Q_ARG(pointer_t, m_ptr), Q_ARG(QStringList, lines), Q_ARG(bool, fromUser)))
+        return false;
+    if (fromUser)
+        m_sentInputs.append(data);
+    return true;
+}
 
-        for (auto &data_single_line : data_split) {
-            QMetaObject::invokeMethod(Lith::instance()->weechat(), "input", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, success), Q_ARG(pointer_t, m_ptr), Q_ARG(QString, data_single_line));
-            success_list.append(success);
-        }
-        return !success_list.contains(false);
-    }
-    return false;
-    //Lith::instance()->weechat()->input(m_ptr, data);
+void Buffer::onInputSent(bool success) {
+    if (m_sentInputs.isEmpty())
+        return;
+    auto data = m_sentInputs.takeFirst();
+    if (!success)
+        failedInputSet(m_failedInput.isEmpty() ? data : m_failedInput + "\n" + data);
 }
 
 void Buffer::fetchMoreLines() {
     m_afterInitialFetch = true;
     if (m_lines->count() >= m_lastRequestedCount) {
-        QMetaObject::invokeMethod(Lith::instance()->weechat(), "fetchLines", Q_ARG(pointer_t, m_ptr), Q_ARG(int, m_lines->count() + 25));
+        auto oldest = m_lines->count() > 0 ? m_lines->at(m_lines->count() - 1).linePtrGet() : 0;
+        if (oldest)
+            QMetaObject::invokeMethod(Lith::instance()->weechat(), "fetchLinesBefore", Q_ARG(pointer_t, oldest), Q_ARG(int, 25));
+        else
+            QMetaObject::invokeMethod(Lith::instance()->weechat(), "fetchLines", Q_ARG(pointer_t, m_ptr), Q_ARG(int, m_lines->count() + 25));
         //Lith::instance()->weechat()->fetchLines(m_ptr, m_lines->count() + 25);
         m_lastRequestedCount = m_lines->count() + 25;
     }
 }
 
+void Buffer::addToHotlist(int priority) {
+    if (priority >= 2)
+        hotMessagesSet(hotMessagesGet() + 1);
+    else if (priority == 1)
+        unreadMessagesSet(unreadMessagesGet() + 1);
+}
+
 void Buffer::clearHotlist() {
-    input("/buffer set hotlist -1");
+    sendInput("/buffer set hotlist -1", false);
     unreadMessagesSet(0);
     hotMessagesSet(0);
 }
 
-BufferLine::BufferLine(Buffer *parent)
-    : QObject(parent)
-{
-    // connections to changed signals are required because FormattedString isn't directly connected to signals that can directly modify it
-    // having it here results in fewer connections and that means lower cpu load when the signals are fired
-    connect(Lith::instance()->settingsGet(), &Settings::shortenLongUrlsThresholdChanged, this, &BufferLine::messageChanged);
-    connect(Lith::instance()->settingsGet(), &Settings::shortenLongUrlsChanged, this, &BufferLine::messageChanged);
-    connect(Lith::instance()->windowHelperGet(), &WindowHelper::themeChanged, this, &BufferLine::messageChanged);
-    connect(Lith::instance()->windowHelperGet(), &WindowHelper::themeChanged, this, &BufferLine::prefixChanged);
-}
-
-BufferLine::~BufferLine() {
-}
-
-Buffer *BufferLine::buffer() {
-    return qobject_cast<Buffer*>(parent());
-}
-
-Lith *BufferLine::lith() {
-    if (buffer())
-        return buffer()->lith();
-    return nullptr;
-}
-
-FormattedString BufferLine::prefixGet() const {
-    return m_prefix;
-}
-
-void BufferLine::prefixSet(const FormattedString &o) {
-    if (m_prefix != o) {
-        m_prefix = o;
-        // TODO this is probably wrong
-        if (m_prefix.toPlain().startsWith("@") || m_prefix.toPlain().startsWith("+")) {
-            m_nick = m_prefix.toPlain().mid(1);
-        }
-        else {
-            m_nick = m_prefix.toPlain();
-        }
-        emit prefixChanged();
-    }
+QDateTime BufferLine::dateGet() const {
+    return QDateTime::fromSecsSinceEpoch(m_date);
 }
 
 QString BufferLine::nickGet() const {
-    return m_nick;
+    // computed on demand so the prefix doesn't get decoded before it's needed
+    auto plain = m_prefix.toPlain();
+    // TODO this is probably wrong
+    if (plain.startsWith("@") || plain.startsWith("+")) {
+        return plain.mid(1);
+    }
+    return plain;
 }
 
-FormattedString BufferLine::messageGet() const {
-    return m_message;
+bool BufferLine::isSelfMsgGet() const {
+    return hasTag(Tags::SelfMsg);
 }
 
-void BufferLine::messageSet(const FormattedString &o) {
-    if (m_message != o) {
-        m_message = o;
-        emit messageChanged();
-    }
+int BufferLine::hotlistPriority() const {
+    if (!displayedGet() || hasTag(Tags::NotifyNone))
+        return -1;
+    if (highlightGet() || hasTag(Tags::NotifyHighlight))
+        return 3;
+    if (hasTag(Tags::NotifyPrivate))
+        return 2;
+    if (hasTag(Tags::NotifyMessage))
+        return 1;
+    // lines without a notify tag go to the low level
+    return 0;
 }
 
-bool BufferLine::isSelfMsgGet() {
-    return m_tags_array.contains("self_msg");
+qsizetype BufferLine::memoryUsage() const {
+    // the strings count their own size in
+    return sizeof(BufferLine) - 2 * sizeof(FormattedString) + m_tags.memoryUsage() + m_message.memoryUsage() + m_prefix.memoryUsage();
 }
 
 QColor BufferLine::nickColorGet() const {
@@ -289,25 +390,176 @@ QColor BufferLine::nickColorGet() const {
     return QColor();
 }
 
-bool BufferLine::isPrivMsgGet() {
-    return m_tags_array.contains("irc_privmsg");
+bool BufferLine::isPrivMsgGet() const {
+    return hasTag(Tags::IrcPrivmsg);
 }
 
-bool BufferLine::isJoinPartQuitMsgGet() {
-    return m_tags_array.contains("irc_quit") || m_tags_array.contains("irc_join") || m_tags_array.contains("irc_part");
+bool BufferLine::isJoinPartQuitMsgGet() const {
+    return m_tags.mask & (Tags::bit(Tags::IrcJoin) | Tags::bit(Tags::IrcPart) | Tags::bit(Tags::IrcQuit));
 }
 
-QString BufferLine::colorlessNicknameGet() {
-    return m_nick;
+QString BufferLine::colorlessNicknameGet() const {
+    return nickGet();
 }
 
-QString BufferLine::colorlessTextGet() {
+QString BufferLine::colorlessTextGet() const {
     auto messageStripped = QTextDocumentFragment::fromHtml(m_message).toPlainText();
     return messageStripped;
 }
 
-QObject *BufferLine::bufferGet() {
-    return parent();
+LineModel::LineModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+    // the formatting of all lines depends on these, a single connection for the whole buffer is enough
+    auto formattingChanged = [this]() {
+        if (!m_lines.isEmpty())
+            emit dataChanged(index(0), index(m_lines.count() - 1), { PrefixRole, MessageRole, NickColorRole });
+    };
+    connect(Lith::instance()->settingsGet(), &Settings::shortenLongUrlsThresholdChanged, this, formattingChanged);
+    connect(Lith::instance()->settingsGet(), &Settings::shortenLongUrlsChanged, this, formattingChanged);
+    connect(Lith::instance()->windowHelperGet(), &WindowHelper::themeChanged, this, formattingChanged);
+}
+
+int LineModel::rowCount(const QModelIndex &parent) const {
+    if (parent.isValid())
+        return 0;
+    return m_lines.count();
+}
+
+QVariant LineModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() < 0 || index.row() >= m_lines.count())
+        return QVariant();
+    const auto &line = m_lines[index.row()];
+    switch (role) {
+    case PrefixRole:
+        return QVariant::fromValue(line.prefixGet());
+    case Qt::DisplayRole:
+    case MessageRole:
+        return QVariant::fromValue(line.messageGet());
+    case DateRole:
+        return line.dateGet();
+    case HighlightRole:
+        return line.highlightGet();
+    case DisplayedRole:
+        return line.displayedGet();
+    case NickRole:
+        return line.nickGet();
+    case NickColorRole:
+        return line.nickColorGet();
+    case ColorlessNicknameRole:
+        return line.colorlessNicknameGet();
+    case ColorlessTextRole:
+        return line.colorlessTextGet();
+    case IsSelfMsgRole:
+        return line.isSelfMsgGet();
+    case IsPrivMsgRole:
+        return line.isPrivMsgGet();
+    case IsJoinPartQuitMsgRole:
+        return line.isJoinPartQuitMsgGet();
+    case TagsRole:
+        return line.tags_arrayGet();
+    }
+    return QVariant();
+}
+
+QHash<int, QByteArray> LineModel::roleNames() const {
+    return {
+        { PrefixRole, "prefix" },
+        { MessageRole, "message" },
+        { DateRole, "date" },
+        { HighlightRole, "highlight" },
+        { DisplayedRole, "displayed" },
+        { NickRole, "nick" },
+        { NickColorRole, "nickColor" },
+        { ColorlessNicknameRole, "colorlessNickname" },
+        { ColorlessTextRole, "colorlessText" },
+        { IsSelfMsgRole, "isSelfMsg" },
+        { IsPrivMsgRole, "isPrivMsg" },
+        { IsJoinPartQuitMsgRole, "isJoinPartQuitMsg" },
+        { TagsRole, "tags_array" }
+    };
+}
+
+bool LineModel::removeRows(int row, int count, const QModelIndex &parent) {
+    if (parent.isValid() || count <= 0 || row < 0 || row + count > m_lines.count())
+        return false;
+    beginRemoveRows(QModelIndex(), row, row + count - 1);
+    shiftRows(row + count, -count);
+    for (int i = row; i < row + count; i++)
+        m_rows.remove(m_lines[i].ptrGet());
+    m_lines.remove(row, count);
+    endRemoveRows();
+    emit countChanged();
+    return true;
+}
+
+int LineModel::count() const {
+    return m_lines.count();
+}
+
+const BufferLine &LineModel::at(int i) const {
+    return m_lines.at(i);
+}
+
+int LineModel::indexOf(pointer_t ptr) const {
+    auto it = m_rows.constFind(ptr);
+    if (it == m_rows.constEnd())
+        return -1;
+    return *it + m_rowOffset;
+}
+
+void LineModel::shiftRows(int first, qsizetype by) {
+    // moving the offset and the lines before first back is the same, whichever side is shorter gets updated
+    // new lines mostly go to the top and old ones get evicted from the bottom, neither has to touch the rest
+    if (first < m_lines.count() - first) {
+        m_rowOffset += by;
+        for (int i = 0; i < first; i++)
+            m_rows[m_lines[i].ptrGet()] -= by;
+    }
+    else {
+        for (int i = first; i < m_lines.count(); i++)
+            m_rows[m_lines[i].ptrGet()] += by;
+    }
+}
+
+void LineModel::insert(int i, QList<BufferLine> &&lines) {
+    if (lines.isEmpty() || i < 0 || i > m_lines.count())
+        return;
+    auto count = lines.count();
+    beginInsertRows(QModelIndex(), i, i + count - 1);
+    shiftRows(i, count);
+    for (int j = 0; j < count; j++)
+        m_rows.insert(lines[j].ptrGet(), i + j - m_rowOffset);
+    if (m_lines.isEmpty()) {
+        m_lines = std::move(lines);
+    }
+    else {
+        m_lines.insert(i, count, BufferLine());
+        std::move(lines.begin(), lines.end(), m_lines.begin() + i);
+    }
+    endInsertRows();
+    emit countChanged();
+}
+
+void LineModel::prepend(QList<BufferLine> &&lines) {
+    insert(0, std::move(lines));
+}
+
+void LineModel::append(BufferLine &&line) {
+    beginInsertRows(QModelIndex(), m_lines.count(), m_lines.count());
+    m_rows.insert(line.ptrGet(), m_lines.count() - m_rowOffset);
+    m_lines.append(std::move(line));
+    endInsertRows();
+    emit countChanged();
+}
+
+void LineModel::clear() {
+    beginResetModel();
+    m_lines.clear();
+    m_rows.clear();
+    m_rowOffset = 0;
+    endResetModel();
+    emit countChanged();
 }
 
 Nick::Nick(Buffer *parent)
@@ -344,7 +596,11 @@ void HotListItem::bufferSet(Buffer *o) {
 
 void HotListItem::onCountChanged() {
     if (bufferGet()) {
-        if (countGet().count() >= 3) {
+        if (countGet().count() >= 4) {
+            bufferGet()->hotMessagesSet(countGet()[2] + countGet()[3]);
+            bufferGet()->unreadMessagesSet(countGet()[1]);
+        }
+        else if (countGet().count() >= 3) {
             bufferGet()->hotMessagesSet(countGet()[2]);
             bufferGet()->unreadMessagesSet(countGet()[1]);
         }
@@ -22,6 +22,7 @@
 #include "qmlobjectlist.h"
 #include "protocol.h"
 #include "util/messagelistfilter.h"
+#include "util/tags.h"
 
 #include <QObject>
 #include <QDateTime>
@@ -56,6 +57,106 @@ public:
     QString colorlessName() const;
 };
 
+// A single line of a buffer. It's not a QObject, the buffers keep their lines by value in a LineModel,
+// there can be hundreds of thousands of them.
+class BufferLine {
+public:
+    pointer_t ptrGet() const { return m_ptr; }
+    void ptrSet(pointer_t ptr) { m_ptr = ptr; }
+    // the line the line_data belongs to, zero when it's not known
+    pointer_t linePtrGet() const { return m_linePtr; }
+    void linePtrSet(pointer_t ptr) { m_linePtr = ptr; }
+
+    bool displayedGet() const { return m_displayed; }
+    void displayedSet(bool o) { m_displayed = o; }
+    bool highlightGet() const { return m_highlight; }
+    void highlightSet(bool o) { m_highlight = o; }
+    QDateTime dateGet() const;
+    void dateSet(qint64 secsSinceEpoch) { m_date = secsSinceEpoch; }
+    QStringList tags_arrayGet() const { return m_tags.names(); }
+    void tagsSet(Tags::Set &&o) { m_tags = std::move(o); }
+    bool hasTag(Tags::Known tag) const { return m_tags.has(tag); }
+    const FormattedString &prefixGet() const { return m_prefix; }
+    void prefixSet(const FormattedString &o) { m_prefix = o; }
+    QString nickGet() const;
+    const FormattedString &messageGet() const { return m_message; }
+    void messageSet(const FormattedString &o) { m_message = o; }
+
+    bool isJoinPartQuitMsgGet() const;
+    bool isPrivMsgGet() const;
+    bool isSelfMsgGet() const;
+    // level of the hotlist WeeChat puts the line in (0 low to 3 highlight), -1 if it doesn't
+    int hotlistPriority() const;
+    qsizetype memoryUsage() const;
+    QColor nickColorGet() const;
+    QString colorlessNicknameGet() const;
+    QString colorlessTextGet() const;
+
+private:
+    pointer_t m_ptr { 0 };
+    pointer_t m_linePtr { 0 };
+    // kept the way the relay sends it, the QDateTime is only needed for lines that get displayed
+    qint64 m_date { 0 };
+    Tags::Set m_tags;
+    FormattedString m_message;
+    FormattedString m_prefix;
+    bool m_displayed { false };
+    bool m_highlight { false };
+};
+Q_DECLARE_TYPEINFO(BufferLine, Q_RELOCATABLE_TYPE);
+
+// Lines of a buffer, newest first, each field of a line is a role
+class LineModel : public QAbstractListModel {
+    Q_OBJECT
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+public:
+    enum Roles {
+        PrefixRole = Qt::UserRole + 1,
+        MessageRole,
+        DateRole,
+        HighlightRole,
+        DisplayedRole,
+        NickRole,
+        NickColorRole,
+        ColorlessNicknameRole,
+        ColorlessTextRole,
+        IsSelfMsgRole,
+        IsPrivMsgRole,
+        IsJoinPartQuitMsgRole,
+        TagsRole
+    };
+
+    LineModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+
+    int count() const;
+    const BufferLine &at(int i) const;
+    // -1 if the line isn't there
+    int indexOf(pointer_t ptr) const;
+
+    // all of them get inserted as a single row range, the first one ends up at i
+    void insert(int i, QList<BufferLine> &&lines);
+    void prepend(QList<BufferLine> &&lines);
+    void append(BufferLine &&line);
+    void clear();
+
+signals:
+    void countChanged();
+
+private:
+    // moves the rows of the lines from first to the end in m_rows, before m_lines itself changes
+    void shiftRows(int first, qsizetype by);
+
+    QList<BufferLine> m_lines;
+    // pointer to row, relative to m_rowOffset so prepending doesn't have to touch all of them
+    QHash<pointer_t, qsizetype> m_rows;
+    qsizetype m_rowOffset { 0 };
+};
+
 class Buffer : public QObject {
     Q_OBJECT
     PROPERTY(int, number)
@@ -68,9 +169,15 @@ class Buffer : public QObject {
 
     PROPERTY(int, unreadMessages)
     PROPERTY(int, hotMessages)
+    // the relay didn't list the buffer again after a reconnect
+    PROPERTY(bool, stale)
+    // input from the user that didn't make it to the relay, waiting to be put back to the input field
+    PROPERTY(QString, failedInput)
+    // estimate in bytes, updated periodically
+    Q_PROPERTY(qint64 memoryUsage READ memoryUsageGet NOTIFY memoryUsageChanged)
 
     Q_PROPERTY(MessageFilterList* lines_filtered READ lines_filtered CONSTANT)
-    Q_PROPERTY(QmlObjectList *lines READ lines CONSTANT)
+    Q_PROPERTY(LineModel *lines READ lines CONSTANT)
     Q_PROPERTY(QmlObjectList *nicks READ nicks CONSTANT)
     Q_PROPERTY(int normals READ normalsGet NOTIFY nicksChanged)
     Q_PROPERTY(int voices READ voicesGet NOTIFY nicksChanged)
@@ -84,22 +191,43 @@ public:
 
     Lith *lith();
 
-    //BufferLine *getLine(pointer_t ptr);
-    void prependLine(BufferLine *line);
-    void appendLine(BufferLine *line);
+    pointer_t ptrGet() const;
+    // the buffer was recreated under a different pointer, after WeeChat was restarted
+    void ptrSet(pointer_t ptr);
+
+    // new lines are collected and inserted to the model together, a bouncer can flush hundreds of them at once
+    void prependLine(BufferLine &&line);
+    void appendLine(BufferLine &&line);
+    // lines missed while disconnected, newest first, they belong right above the given line or below everything if it's gone
+    void insertMissedLines(pointer_t newerThan, QList<BufferLine> &&lines);
+    // zero if there are no lines
+    pointer_t newestLinePtr() const;
+    // pending lines included, it's meant for dropping lines the relay sent more than once
+    bool hasLine(pointer_t ptr) const;
+    void clearLines();
+    void evictOldestLines(int count);
+
+    qint64 memoryUsageGet() const;
+    void updateMemoryUsage();
 
     FormattedString titleGet() const;
     void titleSet(const FormattedString &o);
 
     bool isAfterInitialFetch();
 
-    QmlObjectList *lines();
+    // counts a new line the same way HotListItem counts what the relay sends
+    void addToHotlist(int priority);
+
+    LineModel *lines();
     QmlObjectList *nicks();
     MessageFilterList *lines_filtered();
     Q_INVOKABLE Nick *getNick(pointer_t ptr);
     void addNick(pointer_t ptr, Nick* nick);
     void removeNick(pointer_t ptr);
     void clearNicks();
+    // changes between these get applied to the nick list together, with a single nicksChanged
+    void beginNickUpdate();
+    void endNickUpdate();
     Q_INVOKABLE QStringList getVisibleNicks();
     int normalsGet() const;
     int voicesGet() const;
@@ -110,9 +238,13 @@ public:
     bool isChannelGet() const;
     bool isPrivateGet() const;
 
+    // the result of the oldest input that's still waiting for one
+    void onInputSent(bool success);
+
 signals:
     void nicksChanged();
     void titleChanged();
+    void memoryUsageChanged();
 
 public slots:
     bool input(const QString &data);
@@ -120,67 +252,33 @@ public slots:
     void clearHotlist();
 
 private:
-    QmlObjectList *m_lines { nullptr };
+    void flushPendingLines();
+    // only input from the user gets its result reported, commands sent by Lith itself don't
+    bool sendInput(const QString &data, bool fromUser);
+
+    // roughly a frame
+    static constexpr int c_lineBatchInterval { 16 };
+
+    LineModel *m_lines { nullptr };
+    // sent by the user, oldest first, until the result comes back
+    QStringList m_sentInputs;
+    // oldest first, not in m_lines yet
+    QList<BufferLine> m_pendingLines;
+    // m_lines has its own index
+    QSet<pointer_t> m_pendingLinePtrs;
     QmlObjectList *m_nicks { nullptr };
+    QHash<pointer_t, Nick*> m_nickIndex;
+    // waiting for endNickUpdate
+    QList<QObject*> m_addedNicks;
+    QSet<QObject*> m_removedNicks;
+    int m_nickUpdates { 0 };
+    bool m_nicksDirty { false };
     MessageFilterList *m_proxyLinesFiltered { nullptr };
     pointer_t m_ptr;
     bool m_afterInitialFetch { false };
     int m_lastRequestedCount { 0 };
     FormattedString m_title {};
-};
-
-class BufferLine : public QObject {
-    Q_OBJECT
-    PROPERTY(QDateTime, date)
-    PROPERTY(bool, displayed)
-    PROPERTY(bool, highlight)
-    PROPERTY(QStringList, tags_array)
-
-    Q_PROPERTY(QString nick READ nickGet NOTIFY prefixChanged)
-    Q_PROPERTY(FormattedString prefix READ prefixGet WRITE prefixSet NOTIFY prefixChanged)
-    Q_PROPERTY(FormattedString message READ messageGet WRITE messageSet NOTIFY messageChanged)
-
-    Q_PROPERTY(bool isJoinPartQuitMsg READ isJoinPartQuitMsgGet NOTIFY tags_arrayChanged)
-    Q_PROPERTY(bool isPrivMsg READ isPrivMsgGet NOTIFY tags_arrayChanged)
-    Q_PROPERTY(bool isSelfMsg READ isSelfMsgGet NOTIFY tags_arrayChanged)
-    Q_PROPERTY(QColor nickColor READ nickColorGet NOTIFY messageChanged)
-    Q_PROPERTY(QString colorlessNickname READ colorlessNicknameGet NOTIFY messageChanged)
-    Q_PROPERTY(QString colorlessText READ colorlessTextGet NOTIFY messageChanged) // used here because segments is already chopped up
-    Q_PROPERTY(QObject *buffer READ bufferGet CONSTANT)
-public:
-    BufferLine(Buffer *parent);
-    virtual ~BufferLine();
-
-    Buffer *buffer();
-    Lith *lith();
-
-    void setParent(Buffer *parent);
-
-    FormattedString prefixGet() const;
-    void prefixSet(const FormattedString &o);
-    QString nickGet() const;
-    FormattedString messageGet() const;
-    void messageSet(const FormattedString &o);
-
-    bool isJoinPartQuitMsgGet();
-    bool isPrivMsgGet();
-    bool isSelfMsgGet();
-    QColor nickColorGet() const;
-    QString colorlessNicknameGet();
-    QString colorlessTextGet();
-
-    QObject *bufferGet();
-
-signals:
-    void messageChanged();
-    void prefixChanged();
-
-private slots:
-
-private:
-    FormattedString m_message;
-    FormattedString m_prefix;
-    QString m_nick;
+    qint64 m_memoryUsage { 0 };
 };
 
 class HotListItem : public QObject {
@@ -196,7 +294,8 @@ public:
 signals:
     void bufferChanged();
 
-private slots:
+public slots:
+    // applies the counts to the buffer
     void onCountChanged();
 
 private:
@@ -22,6 +22,7 @@
 #include "windowhelper.h"
 
 #include <iostream>
+#include <algorithm>
 #include <QThread>
 #include <QEventLoop>
 #include <QAbstractEventDispatcher>
@@ -146,11 +147,19 @@ Lith::Lith(QObject *parent)
         else
             m_selectedBufferNicks->setSourceModel(nullptr);
     });
+    connect(m_weechat, &Weechat::inputSent, this, [this](pointer_t ptr, bool success) {
+        auto buffer = getBuffer(ptr);
+        if (buffer)
+            buffer->onInputSent(success);
+    }, Qt::QueuedConnection);
 #ifndef Q_OS_WASM
     m_weechat->moveToThread(m_weechatThread);
     m_weechatThread->start();
 #endif
     QTimer::singleShot(1, m_weechat, &Weechat::init);
+
+    connect(m_evictionTimer, &QTimer::timeout, this, &Lith::evictLines);
+    m_evictionTimer->start(60 * 1000);
 }
 
 bool Lith::hasPassphrase() const {
@@ -162,114 +171,309 @@ void Lith::resetData() {
 
     m_buffers->clear();
     m_bufferMap.clear();
-    m_lineMap.clear();
+    m_resumePoints.clear();
+    for (auto &i : m_hotList) {
+        if (i)
+            i->deleteLater();
+    }
     m_hotList.clear();
 }
 
+void Lith::resumeData() {
+    // nothing to keep, start from scratch
+    if (m_buffers->count() == 0) {
+        resetData();
+        return;
+    }
+    m_resumePoints.clear();
+    // whatever the relay lists again during initialization stops being stale
+    for (int i = 0; i < m_buffers->count(); i++) {
+        auto buffer = m_buffers->get<Buffer>(i);
+        if (buffer)
+            buffer->staleSet(true);
+    }
+}
+
+void Lith::evictLines() {
+    auto perBuffer = qMax(c_evictionFloor, settingsGet()->linesPerBufferGet());
+    auto total = settingsGet()->linesTotalGet();
+
+    // the open buffer is left alone, the user may be scrolling through it
+    QList<Buffer*> candidates;
+    qint64 held = 0;
+    for (int i = 0; i < m_buffers->count(); i++) {
+        auto buffer = m_buffers->get<Buffer>(i);
+        if (!buffer)
+            continue;
+        held += buffer->lines()->count();
+        if (buffer != selectedBuffer())
+            candidates.append(buffer);
+    }
+
+    for (auto buffer : candidates) {
+        auto count = buffer->lines()->count();
+        if (count > perBuffer) {
+            buffer->evictOldestLines(count - perBuffer);
+            held -= count - perBuffer;
+        }
+    }
+    if (held > total) {
+        // the biggest ones go first
+        std::sort(candidates.begin(), candidates.end(), [](Buffer *a, Buffer *b) {
+            return a->lines()->count() > b->lines()->count();
+        });
+        for (auto buffer : candidates) {
+            if (held <= total)
+                break;
+            auto count = qMin<qint64>(held - total, buffer->lines()->count() - c_evictionFloor);
+            if (count > 0) {
+                buffer->evictOldestLines(count);
+                held -= count;
+            }
+        }
+    }
+
+    for (int i = 0; i < m_buffers->count(); i++) {
+        auto buffer = m_buffers->get<Buffer>(i);
+        if (buffer)
+            buffer->updateMemoryUsage();
+    }
+}
+
 void Lith::reconnect() {
     m_weechat->restart();
 }
 
+// Copies all (known and unknown) fields of a row to the properties of the same name
+static void setProperties(QObject *object, const Protocol::HData &hda, int row, std::initializer_list<Protocol::Field> skip = {}) {
+    for (int column = 0; column < hda.schema.count(); column++) {
+        const auto &key = hda.schema[column];
+        if (key.type == Protocol::Type::Unknown || std::find(skip.begin(), skip.end(), key.field) != skip.end())
+            continue;
+        object->setProperty(key.property.constData(), hda.value(row, column));
+    }
+}
+
+// Binds the line_data columns to the BufferLine setters once per message
+class LineDecoder {
+public:
+    LineDecoder(const Protocol::HData &hda)
+        : m_hda(hda)
+    {
+        using Protocol::Field;
+        using Protocol::Type;
+        for (int column = 0; column < hda.schema.count(); column++) {
+            const auto &key = hda.schema[column];
+            if (key.field == Field::Buffer && key.type == Type::Pointer)
+                m_buffer = column;
+            else if (key.field == Field::Date && key.type == Type::Time)
+                m_date = column;
+            else if (key.field == Field::Displayed && key.type == Type::Char)
+                m_displayed = column;
+            else if (key.field == Field::Highlight && key.type == Type::Char)
+                m_highlight = column;
+            else if (key.field == Field::TagsArray && key.type == Type::Array)
+                m_tags = column;
+            else if (key.field == Field::Prefix && key.type == Type::String)
+                m_prefix = column;
+            else if (key.field == Field::Message && key.type == Type::String)
+                m_message = column;
+        }
+    }
+
+    pointer_t buffer(int row) const {
+        if (m_buffer < 0)
+            return 0;
+        return m_hda.columns[m_buffer].pointers[row];
+    }
+
+    BufferLine decode(int row) const {
+        const auto &columns = m_hda.columns;
+        BufferLine line;
+        line.ptrSet(m_hda.lastPointer(row));
+        // line_data is always the last one, lines that came as events don't have the line itself
+        if (m_hda.path.count() >= 2 && m_hda.path[m_hda.path.count() - 2] == "line")
+            line.linePtrSet(m_hda.pointer(row, m_hda.path.count() - 2));
+        if (m_date >= 0)
+            line.dateSet(columns[m_date].times[row]);
+        if (m_displayed >= 0)
+            line.displayedSet(columns[m_displayed].chars[row]);
+        if (m_highlight >= 0)
+            line.highlightSet(columns[m_highlight].chars[row]);
+        if (m_tags >= 0)
+            line.tagsSet(Tags::Set(columns[m_tags].tags[row]));
+        if (m_prefix >= 0)
+            line.prefixSet(columns[m_prefix].strings[row]);
+        if (m_message >= 0)
+            line.messageSet(columns[m_message].strings[row]);
+        return line;
+    }
+
+private:
+    const Protocol::HData &m_hda;
+    int m_buffer { -1 };
+    int m_date { -1 };
+    int m_displayed { -1 };
+    int m_highlight { -1 };
+    int m_tags { -1 };
+    int m_prefix { -1 };
+    int m_message { -1 };
+};
+
 void Lith::handleBufferInitialization(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
+    auto nameColumn = hda.columnIndex(Protocol::Field::Name);
+    for (int row = 0; row < hda.count(); row++) {
         // buffer
-        auto ptr = i.pointers.first();
-        auto b = new Buffer(this, ptr);
-        for (auto j : i.objects.keys()) {
-            b->setProperty(qPrintable(j), i.objects[j]);
+        auto ptr = hda.firstPointer(row);
+        auto b = getBuffer(ptr);
+        // after a WeeChat restart, the pointer may have been given to a different buffer
+        if (b && nameColumn >= 0 && b->nameGet() != hda.columns[nameColumn].strings[row])
+            b = nullptr;
+        if (!b && nameColumn >= 0) {
+            // WeeChat was restarted in the meantime, the buffer is the same but the lines aren't
+            b = getStaleBuffer(hda.columns[nameColumn].strings[row]);
+            if (b) {
+                // its old pointer may belong to another buffer by now
+                if (m_bufferMap.value(b->ptrGet()) == b)
+                    m_bufferMap.remove(b->ptrGet());
+                m_bufferMap[ptr] = b;
+                b->ptrSet(ptr);
+                b->clearLines();
+            }
+        }
+        if (!b) {
+            b = new Buffer(this, ptr);
+            setProperties(b, hda, row);
+            addBuffer(ptr, b);
+            continue;
+        }
+        setProperties(b, hda, row);
+        b->staleSet(false);
+        // the buffer was kept from before the reconnect, only what was missed needs to be fetched
+        auto newest = b->newestLinePtr();
+        if (newest) {
+            m_resumePoints[ptr] = { newest, c_resumeFetchCount };
+            QMetaObject::invokeMethod(weechat(), "fetchNewLines", Q_ARG(pointer_t, ptr), Q_ARG(int, c_resumeFetchCount));
         }
-        addBuffer(ptr, b);
     }
 }
 
 void Lith::handleFirstReceivedLine(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
+    LineDecoder decoder(hda);
+    for (int row = 0; row < hda.count(); row++) {
         // buffer - lines - line - line_data
-        auto bufPtr = i.pointers.first();
-        auto linePtr = i.pointers.last();
+        auto bufPtr = hda.firstPointer(row);
+        auto linePtr = hda.lastPointer(row);
         auto buffer = getBuffer(bufPtr);
         if (!buffer) {
             qWarning() << "Line missing a parent:";
             continue;
         }
-        auto line = getLine(bufPtr, linePtr);
-        if (line)
+        // buffers kept from before a reconnect get their new lines from handleFetchNewLines
+        if (buffer->hasLine(linePtr) || m_resumePoints.contains(bufPtr))
             continue;
-        line = new BufferLine(buffer);
-        for (auto j : i.objects.keys()) {
-            if (j != "buffer")
-                line->setProperty(qPrintable(j), i.objects[j]);
-        }
-        buffer->appendLine(line);
-        addLine(bufPtr, linePtr, line);
+        buffer->appendLine(decoder.decode(row));
     }
 }
 
 void Lith::handleHotlistInitialization(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
-        // hotlist
-        auto ptr = i.pointers.first();
-        auto bufPtr = i.objects["buffer"].value<pointer_t>();
-        auto item = new HotListItem(this);
-        auto buffer = getBuffer(bufPtr);
-        if (buffer) {
-            item->bufferSet(buffer);
-        }
-        for (auto j : i.objects.keys()) {
-            if (j == "buffer")
-                continue;
-            item->setProperty(qPrintable(j), i.objects[j]);
-        }
-        addHotlist(ptr, item);
-    }
+    // after a reconnect there may be items already, handleHotlist takes care of those
+    handleHotlist(hda);
 }
 
 void Lith::handleNicklistInitialization(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
+    // buffers kept from before a reconnect still have their old nicks, even the ones that have none now
+    for (int i = 0; i < m_buffers->count(); i++) {
+        auto buffer = m_buffers->get<Buffer>(i);
+        if (!buffer)
+            continue;
+        buffer->beginNickUpdate();
+        buffer->clearNicks();
+    }
+    for (int row = 0; row < hda.count(); row++) {
         // buffer - nicklist_item
-        auto bufPtr = i.pointers.first();
-        auto nickPtr = i.pointers.last();
+        auto bufPtr = hda.firstPointer(row);
+        auto nickPtr = hda.lastPointer(row);
         auto buffer = getBuffer(bufPtr);
         if (!buffer) {
             qWarning() << "Nick missing a parent:";
             continue;
         }
         auto nick = new Nick(buffer);
-        for (auto j : i.objects.keys()) {
-            nick->setProperty(qPrintable(j), i.objects[j]);
-        }
+        setProperties(nick, hda, row);
         buffer->addNick(nickPtr, nick);
     }
+    for (int i = 0; i < m_buffers->count(); i++) {
+        auto buffer = m_buffers->get<Buffer>(i);
+        if (buffer)
+            buffer->endNickUpdate();
+    }
 }
 
 void Lith::handleFetchLines(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
-        // buffer - lines - line - line_data
-        auto bufPtr = i.pointers.first();
-        auto linePtr = i.pointers.last();
+    LineDecoder decoder(hda);
+    for (int row = 0; row < hda.count(); row++) {
+        // buffer - lines - line - line_data or line - line_data when paging from a line
+        auto bufPtr = decoder.buffer(row);
+        auto linePtr = hda.lastPointer(row);
         auto buffer = getBuffer(bufPtr);
         if (!buffer) {
             qWarning() << "Line missing a parent:";
             continue;
         }
-        auto line = getLine(bufPtr, linePtr);
-        if (line)
+        if (buffer->hasLine(linePtr))
             continue;
-        line = new BufferLine(buffer);
-        for (auto j : i.objects.keys()) {
-            if (j != "buffer")
-                line->setProperty(qPrintable(j), i.objects[j]);
+        buffer->appendLine(decoder.decode(row));
+    }
+}
+
+void Lith::handleFetchNewLines(const Protocol::HData &hda) {
+    if (hda.count() == 0)
+        return;
+    // buffer - lines - line - line_data, newest first
+    auto bufPtr = hda.firstPointer(0);
+    auto buffer = getBuffer(bufPtr);
+    if (!buffer || !m_resumePoints.contains(bufPtr))
+        return;
+    auto resumePoint = m_resumePoints.value(bufPtr);
+
+    int resumeRow = -1;
+    for (int row = 0; row < hda.count(); row++) {
+        if (hda.lastPointer(row) == resumePoint.line) {
+            resumeRow = row;
+            break;
         }
-        buffer->appendLine(line);
-        addLine(bufPtr, linePtr, line);
     }
+    // the gap is bigger than what was asked for, go further back
+    if (resumeRow < 0 && hda.count() >= resumePoint.requested && resumePoint.requested < c_resumeFetchLimit) {
+        auto count = qMin(resumePoint.requested * 4, c_resumeFetchLimit);
+        m_resumePoints[bufPtr].requested = count;
+        QMetaObject::invokeMethod(weechat(), "fetchNewLines", Q_ARG(pointer_t, bufPtr), Q_ARG(int, count));
+        return;
+    }
+    m_resumePoints.remove(bufPtr);
+
+    LineDecoder decoder(hda);
+    QList<BufferLine> missed;
+    for (int row = 0; row < (resumeRow < 0 ? hda.count() : resumeRow); row++) {
+        auto linePtr = hda.lastPointer(row);
+        // already arrived through _buffer_line_added
+        if (buffer->hasLine(linePtr))
+            continue;
+        missed.append(decoder.decode(row));
+    }
+    buffer->insertMissedLines(resumePoint.line, std::move(missed));
 }
 
 void Lith::handleHotlist(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
+    // the counts are kept up to date locally from new lines, this only corrects the drift
+    auto bufferColumn = hda.columnIndex(Protocol::Field::Buffer);
+    QSet<pointer_t> current;
+    QSet<Buffer*> counted;
+    for (int row = 0; row < hda.count(); row++) {
         // hotlist
-        auto hlPtr = i.pointers.first();
-        auto bufPtr = qvariant_cast<pointer_t>(i.objects["buffer"]);
+        auto hlPtr = hda.firstPointer(row);
+        auto bufPtr = bufferColumn >= 0 ? hda.columns[bufferColumn].pointers[row] : 0;
         auto hl = getHotlist(hlPtr);
         auto buf = getBuffer(bufPtr);
         if (!buf) {
@@ -279,26 +483,49 @@ void Lith::handleHotlist(const Protocol::HData &hda) {
         if (!hl) {
             hl = new HotListItem(this);
             hl->bufferSet(buf);
+            addHotlist(hlPtr, hl);
         }
-        for (auto j : i.objects.keys()) {
-            if (j == "buffer")
-                continue;
-            hl->setProperty(qPrintable(j), i.objects[j]);
+        setProperties(hl, hda, row, { Protocol::Field::Buffer });
+        if (buf == selectedBuffer()) {
+            buf->unreadMessagesSet(0);
+            buf->hotMessagesSet(0);
+        }
+        else {
+            // the local counts could have changed even if the relay's didn't
+            hl->onCountChanged();
+        }
+        current.insert(hlPtr);
+        counted.insert(buf);
+    }
+    // whatever isn't in the relay's hotlist anymore was read somewhere else
+    for (auto it = m_hotList.begin(); it != m_hotList.end(); ) {
+        if (!current.contains(it.key())) {
+            if (it.value())
+                it.value()->deleteLater();
+            it = m_hotList.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    for (int i = 0; i < m_buffers->count(); i++) {
+        auto buffer = m_buffers->get<Buffer>(i);
+        if (buffer && !counted.contains(buffer)) {
+            buffer->unreadMessagesSet(0);
+            buffer->hotMessagesSet(0);
         }
     }
 }
 
 void Lith::_buffer_opened(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
+    for (int row = 0; row < hda.count(); row++) {
         // buffer
-        auto bufPtr = i.pointers.first();
+        auto bufPtr = hda.firstPointer(row);
         auto buffer = getBuffer(bufPtr);
         if (buffer)
             continue;
         buffer = new Buffer(this, bufPtr);
-        for (auto j : i.objects.keys()) {
-            buffer->setProperty(qPrintable(j), i.objects[j]);
-        }
+        setProperties(buffer, hda, row);
         addBuffer(bufPtr, buffer);
     }
 }
@@ -328,7 +555,7 @@ void Lith::_buffer_unhidden(const Protocol::HData &hda) {
 }
 
 void Lith::_buffer_renamed(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
+    for (auto &i : hda.items()) {
         // buffer
         auto bufPtr = i.pointers.first();
         auto buf = getBuffer(bufPtr);
@@ -343,7 +570,7 @@ void Lith::_buffer_renamed(const Protocol::HData &hda) {
 }
 
 void Lith::_buffer_title_changed(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
+    for (auto &i : hda.items()) {
         // buffer
         auto bufPtr = i.pointers.first();
         auto buf = getBuffer(bufPtr);
@@ -354,7 +581,7 @@ void Lith::_buffer_title_changed(const Protocol::HData &hda) {
 }
 
 void Lith::_buffer_localvar_added(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
+    for (auto &i : hda.items()) {
         // buffer
         auto bufPtr = i.pointers.first();
         auto buf = getBuffer(bufPtr);
@@ -376,7 +603,7 @@ void Lith::_buffer_localvar_removed(const Protocol::HData &hda) {
 }
 
 void Lith::_buffer_closing(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
+    for (auto &i : hda.items()) {
         // buffer
         auto bufPtr = i.pointers.first();
         auto buffer = getBuffer(bufPtr);
@@ -394,32 +621,35 @@ void Lith::_buffer_cleared(const Protocol::HData &hda) {
 }
 
 void Lith::_buffer_line_added(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
+    LineDecoder decoder(hda);
+    for (int row = 0; row < hda.count(); row++) {
         // line_data
-        auto linePtr = i.pointers.last();
+        auto linePtr = hda.lastPointer(row);
         // path doesn't contain the buffer, we need to retrieve it like this
-        auto bufPtr = qvariant_cast<pointer_t>(i.objects["buffer"]);
+        auto bufPtr = decoder.buffer(row);
         auto buffer = getBuffer(bufPtr);
         if (!buffer) {
             qWarning() << "Line missing a parent:";
             continue;
         }
-        auto line = getLine(bufPtr, linePtr);
-        if (line) {
+        if (buffer->hasLine(linePtr)) {
             continue;
         }
-        line = new BufferLine(buffer);
-        for (auto j : i.objects.keys()) {
-            if (j == "buffer")
-                continue;
-            line->setProperty(qPrintable(j), i.objects[j]);
+        auto line = decoder.decode(row);
+        // the selected buffer is being read, it gets cleared in WeeChat when it's selected anyway
+        if (buffer != selectedBuffer())
+            buffer->addToHotlist(line.hotlistPriority());
+        bool notify = line.highlightGet() || (buffer->isPrivateGet() && line.isPrivMsgGet() && !line.isSelfMsgGet());
+        QString nickname, text;
+        if (notify) {
+            nickname = line.colorlessNicknameGet();
+            text = line.colorlessTextGet();
         }
-        buffer->prependLine(line);
-        addLine(bufPtr, linePtr, line);
-        if (line->highlightGet() || (buffer->isPrivateGet() && line->isPrivMsgGet() && !line->isSelfMsgGet())) {
+        buffer->prependLine(std::move(line));
+        if (notify) {
             QString title;
             if (buffer->isChannelGet() || buffer->isServerGet()) {
-                title = tr("New highlight in %1 from %2").arg(buffer->short_nameGet()).arg(line->colorlessNicknameGet());
+                title = tr("New highlight in %1 from %2").arg(buffer->short_nameGet()).arg(nickname);
             }
             else {
                 title = tr("New message from %1").arg(buffer->short_nameGet());
@@ -427,13 +657,13 @@ void Lith::_buffer_line_added(const Protocol::HData &hda) {
 
 #ifdef __linux
             QDBusInterface notifications("org.freedesktop.Notifications", "/org/freedesktop/Notifications", "org.freedesktop.Notifications", QDBusConnection::sessionBus());
-            auto reply = notifications.call("Notify", "Lith", 0U, "org.LithApp.Lith", title, line->colorlessTextGet(), QStringList{}, QVariantMap{}, -1);
+            auto reply = notifications.call("Notify", "Lith", 0U, "org.LithApp.Lith", title, text, QStringList{}, QVariantMap{}, -1);
 #else
             static QIcon appIcon(":/icon.png");
             static QSystemTrayIcon *icon = new QSystemTrayIcon(appIcon);
             icon->show();
 
-            icon->showMessage(title, line->colorlessTextGet(), appIcon);
+            icon->showMessage(title, text, appIcon);
 #endif // __linux
         }
     }
@@ -441,41 +671,50 @@ void Lith::_buffer_line_added(const Protocol::HData &hda) {
 
 void Lith::_nicklist(const Protocol::HData &hda) {
     Buffer *previousBuffer = nullptr;
-    for (auto &i : hda.data) {
+    for (int row = 0; row < hda.count(); row++) {
         // buffer - nicklist_item
-        auto bufPtr = i.pointers.first();
-        auto nickPtr = i.pointers.last();
+        auto bufPtr = hda.firstPointer(row);
+        auto nickPtr = hda.lastPointer(row);
         auto buffer = getBuffer(bufPtr);
         if (!buffer)
             continue;
-        if (buffer != previousBuffer)
+        if (buffer != previousBuffer) {
+            if (previousBuffer)
+                previousBuffer->endNickUpdate();
+            buffer->beginNickUpdate();
             buffer->clearNicks();
+        }
         previousBuffer = buffer;
         auto nick = new Nick(buffer);
-        for (auto j : i.objects.keys()) {
-            nick->setProperty(qPrintable(j), i.objects[j]);
-        }
+        setProperties(nick, hda, row);
         buffer->addNick(nickPtr, nick);
     }
+    if (previousBuffer)
+        previousBuffer->endNickUpdate();
 }
 
 void Lith::_nicklist_diff(const Protocol::HData &hda) {
-    for (auto &i : hda.data) {
+    auto diffColumn = hda.columnIndex(Protocol::Field::Diff);
+    if (diffColumn < 0 || hda.schema[diffColumn].type != Protocol::Type::Char)
+        return;
+    // a netsplit can bring thousands of rows, the nick list gets updated only once per buffer
+    QList<Buffer*> updated;
+    for (int row = 0; row < hda.count(); row++) {
         // buffer - nicklist_item
-        auto bufPtr = i.pointers.first();
-        auto nickPtr = i.pointers.last();
+        auto bufPtr = hda.firstPointer(row);
+        auto nickPtr = hda.lastPointer(row);
         auto buffer = getBuffer(bufPtr);
         if (!buffer)
             continue;
-        auto op = qvariant_cast<char>(i.objects["_diff"]);
+        if (!updated.contains(buffer)) {
+            updated.append(buffer);
+            buffer->beginNickUpdate();
+        }
+        auto op = hda.columns[diffColumn].chars[row];
         switch (op) {
         case '+': {
             auto nick = new Nick(buffer);
-            for (auto j : i.objects.keys()) {
-                if (j == "_diff")
-                    continue;
-                nick->setProperty(qPrintable(j), i.objects[j]);
-            }
+            setProperties(nick, hda, row, { Protocol::Field::Diff });
             buffer->addNick(nickPtr, nick);
             break;
         }
@@ -488,18 +727,15 @@ void Lith::_nicklist_diff(const Protocol::HData &hda) {
             auto nick = buffer->getNick(nickPtr);
             if (!nick)
                 break;
-            for (auto j : i.objects.keys()) {
-                if (j == "_diff")
-                    continue;
-                nick->setProperty(qPrintable(j), i.objects[j]);
-            }
+            setProperties(nick, hda, row, { Protocol::Field::Diff });
             break;
         }
         default:
             break;
         }
-
     }
+    for (auto buffer : updated)
+        buffer->endNickUpdate();
 }
 
 void Lith::_pong(const FormattedString &str) {
@@ -533,21 +769,11 @@ Buffer *Lith::getBuffer(pointer_t ptr) {
     return nullptr;
 }
 
-void Lith::addLine(pointer_t bufPtr, pointer_t linePtr, BufferLine *line) {
-    auto ptr = bufPtr << 32 | linePtr;
-    if (m_lineMap.contains(ptr)) {
-        // TODO
-        qCritical() << "Line with ptr" << QString("%1").arg(ptr, 16, 16, QChar('0')) << "already exists";
-        qCritical() << "Original: " << m_lineMap[ptr]->messageGet();
-        qCritical() << "New:" << line->messageGet();
-    }
-    m_lineMap[ptr] = line;
-}
-
-BufferLine *Lith::getLine(pointer_t bufPtr, pointer_t linePtr) {
-    auto ptr = bufPtr << 32 | linePtr;
-    if (m_lineMap.contains(ptr)) {
-        return m_lineMap[ptr];
+Buffer *Lith::getStaleBuffer(const FormattedString &name) {
+    for (int i = 0; i < m_buffers->count(); i++) {
+        auto buffer = m_buffers->get<Buffer>(i);
+        if (buffer && buffer->staleGet() && buffer->nameGet() == name)
+            return buffer;
     }
     return nullptr;
 }
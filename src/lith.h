@@ -27,12 +27,13 @@
 
 #include <QSortFilterProxyModel>
 #include <QPointer>
+#include <QSet>
+#include <QTimer>
 
 class Weechat;
 class ProxyBufferList;
 
 class Buffer;
-class BufferLine;
 class HotListItem;
 
 class Lith : public QObject {
@@ -87,6 +88,10 @@ public:
 
 public slots:
     void resetData();
+    // keeps the buffers and their lines when reconnecting, initialization then only fills in what changed
+    void resumeData();
+    // keeps the lines within the limits from the settings
+    void evictLines();
     void reconnect();
 
     void handleBufferInitialization(const Protocol::HData &hda);
@@ -95,6 +100,7 @@ public slots:
     void handleNicklistInitialization(const Protocol::HData &hda);
 
     void handleFetchLines(const Protocol::HData &hda);
+    void handleFetchNewLines(const Protocol::HData &hda);
     void handleHotlist(const Protocol::HData &hda);
 
     void _buffer_opened(const Protocol::HData &hda);
@@ -120,8 +126,7 @@ protected:
     void addBuffer(pointer_t ptr, Buffer *b);
     void removeBuffer(pointer_t ptr);
     Buffer *getBuffer(pointer_t ptr);
-    void addLine(pointer_t bufPtr, pointer_t linePtr, BufferLine *line);
-    BufferLine *getLine(pointer_t bufPtr, pointer_t linePtr);
+    Buffer *getStaleBuffer(const FormattedString &name);
     void addHotlist(pointer_t ptr, HotListItem *hotlist);
     HotListItem *getHotlist(pointer_t ptr);
 
@@ -149,8 +154,21 @@ private:
     QString m_error {};
 
     QMap<pointer_t, QPointer<Buffer>> m_bufferMap {};
-    QMap<pointer_t, QPointer<BufferLine>> m_lineMap;
     QMap<pointer_t, QPointer<HotListItem>> m_hotList;
+
+    QTimer *m_evictionTimer { new QTimer(this) };
+    // what's left of a buffer when lines have to go because of the total limit
+    static constexpr int c_evictionFloor { 100 };
+
+    // newest line each buffer had before reconnecting and how many lines were requested to find it
+    struct ResumePoint {
+        pointer_t line { 0 };
+        int requested { 0 };
+    };
+    QHash<pointer_t, ResumePoint> m_resumePoints;
+    static constexpr int c_resumeFetchCount { 25 };
+    // past this, the gap is left as it is
+    static constexpr int c_resumeFetchLimit { 1600 };
 };
 
 class ProxyBufferList : public QSortFilterProxyModel {
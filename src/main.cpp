@@ -33,6 +33,7 @@
 #include <QPalette>
 #include <QMetaType>
 #include <QIcon>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[])
 {
@@ -46,7 +47,25 @@ int main(int argc, char *argv[])
 
     QApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption recordOption("record", "Write all messages received from the relay to <file>.", "file");
+    QCommandLineOption replayOption("replay", "Don't connect to the relay, replay messages from <file> instead.", "file");
+    QCommandLineOption replayFastOption("replay-fast", "Replay the messages as fast as possible instead of at the recorded pace.");
+    parser.addOptions({ recordOption, replayOption, replayFastOption });
+    parser.process(app);
+
     Lith::instance();
+    auto weechat = Lith::instance()->weechat();
+    if (parser.isSet(recordOption)) {
+        auto path = parser.value(recordOption);
+        QMetaObject::invokeMethod(weechat, [weechat, path]() { weechat->record(path); }, Qt::QueuedConnection);
+    }
+    if (parser.isSet(replayOption)) {
+        auto path = parser.value(replayOption);
+        auto fast = parser.isSet(replayFastOption);
+        QMetaObject::invokeMethod(weechat, [weechat, path, fast]() { weechat->replay(path, fast); }, Qt::QueuedConnection);
+    }
     Lith::instance()->windowHelperGet()->init();
 
     auto fontFamilyFromSettings = Lith::instance()->settingsGet()->baseFontFamilyGet();
@@ -92,11 +111,10 @@ int main(int argc, char *argv[])
         return s.toPlain();
     });
     qmlRegisterUncreatableType<ColorTheme>("lith", 1, 0, "ColorTheme", "");
-    qmlRegisterUncreatableType<BufferLine>("lith", 1, 0, "Line", "");
     qmlRegisterUncreatableType<Lith>("lith", 1, 0, "Lith", "");
     qmlRegisterUncreatableType<Nick>("lith", 1, 0, "Nick", "");
     qmlRegisterUncreatableType<Buffer>("lith", 1, 0, "Buffer", "");
-    //qmlRegisterUncreatableType<LineModel>("lith", 1, 0, "LineModel", "");
+    qmlRegisterUncreatableType<LineModel>("lith", 1, 0, "LineModel", "");
     qmlRegisterUncreatableType<ClipboardProxy>("lith", 1, 0, "ClipboardProxy", "");
     qmlRegisterUncreatableType<Settings>("lith", 1, 0, "Settings", "");
     qmlRegisterUncreatableType<Uploader>("lith", 1, 0, "Uploader", "");
@@ -0,0 +1,140 @@
+// Lith
+// Copyright (C) 2020 Martin Bříza
+// Copyright (C) 2020 Jakub Mach
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; If not, see <http://www.gnu.org/licenses/>.
+
+#include "parsepipeline.h"
+
+#include <QThread>
+#include <QElapsedTimer>
+
+ParsePipeline::ParsePipeline() {
+    // leave a core for the GUI and the socket
+    m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount() - 1, 4));
+}
+
+ParsePipeline::~ParsePipeline() {
+    setSink({});
+    clear();
+    m_pool.waitForDone();
+}
+
+void ParsePipeline::setSink(const Sink &sink) {
+    QMutexLocker locker(&m_mutex);
+    m_sink = sink;
+}
+
+quint64 ParsePipeline::reserve() {
+    QMutexLocker locker(&m_mutex);
+    if (m_stats.inFlight >= c_maxInFlight) {
+        QElapsedTimer timer;
+        timer.start();
+        m_stats.stalls++;
+        while (m_stats.inFlight >= c_maxInFlight)
+            m_notFull.wait(&m_mutex);
+        m_stats.stalledMsecs += timer.elapsed();
+    }
+    m_stats.submitted++;
+    m_stats.inFlight++;
+    m_stats.maxInFlight = qMax(m_stats.maxInFlight, m_stats.inFlight);
+    return m_nextSequence++;
+}
+
+void ParsePipeline::submit(const QByteArray &data) {
+    auto sequence = reserve();
+#ifdef Q_OS_WASM
+    complete(sequence, parse(data));
+#else
+    m_pool.start([this, sequence, data]() {
+        complete(sequence, parse(data));
+    });
+#endif
+}
+
+void ParsePipeline::submitParsed(Message &&message) {
+    complete(reserve(), std::move(message));
+}
+
+void ParsePipeline::complete(quint64 sequence, Message &&message) {
+    QMutexLocker locker(&m_mutex);
+    // cleared while this one was being parsed
+    if (sequence < m_nextDelivery) {
+        m_stats.inFlight--;
+        m_notFull.wakeAll();
+        return;
+    }
+    // stays in flight until it's delivered, a slow message holds up all the ones after it
+    m_finished.insert(sequence, std::move(message));
+
+    QList<Message> ready;
+    while (!m_finished.isEmpty() && m_finished.firstKey() == m_nextDelivery) {
+        ready.append(m_finished.take(m_nextDelivery));
+        m_nextDelivery++;
+        m_stats.inFlight--;
+    }
+    m_stats.delivered += ready.count();
+    // still under the lock so the batches can't overtake each other
+    if (!ready.isEmpty() && m_sink)
+        m_sink(std::move(ready));
+    m_notFull.wakeAll();
+}
+
+void ParsePipeline::clear() {
+    QMutexLocker locker(&m_mutex);
+    // results of messages that are still being parsed get dropped when they're done
+    m_nextDelivery = m_nextSequence;
+    // these were parsed already, nothing else would count them down
+    while (!m_finished.isEmpty()) {
+        m_finished.erase(m_finished.begin());
+        m_stats.inFlight--;
+    }
+    m_notFull.wakeAll();
+}
+
+ParsePipeline::Stats ParsePipeline::stats() const {
+    QMutexLocker locker(&m_mutex);
+    return m_stats;
+}
+
+ParsePipeline::Message ParsePipeline::parse(const QByteArray &data) {
+    Message result;
+    Protocol::Cursor s(data);
+
+    result.id = Protocol::parse<Protocol::String>(s);
+
+    char type[4] = { 0 };
+    s.readRaw(type, 3);
+
+    if (qstrcmp(type, "hda") == 0) {
+        result.type = Message::HData;
+        result.hdata = Protocol::parse<Protocol::HData>(s);
+    }
+    else if (qstrcmp(type, "htb") == 0) {
+        result.type = Message::HashTable;
+        result.hashTable = Protocol::parse<Protocol::HashTable>(s);
+    }
+    else if (qstrcmp(type, "str") == 0) {
+        result.type = Message::String;
+        result.string = Protocol::parse<Protocol::String>(s);
+    }
+    else {
+        qCritical() << "onMessageReceived is not handling type: " << type;
+    }
+
+    if (!s.atEnd()) {
+        qCritical() << "STREAM WAS NOT AT END!!!";
+    }
+    return result;
+}
@@ -0,0 +1,92 @@
+// Lith
+// Copyright (C) 2020 Martin Bříza
+// Copyright (C) 2020 Jakub Mach
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PARSEPIPELINE_H
+#define PARSEPIPELINE_H
+
+#include "protocol.h"
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QMap>
+
+#include <functional>
+
+// Parses relay messages on a pool of worker threads so big messages don't hold up reading the socket.
+// Messages are parsed independently but handed over to the sink strictly in the order they were submitted.
+class ParsePipeline {
+public:
+    struct Message {
+        enum Type {
+            Unknown,
+            HData,
+            HashTable,
+            String
+        };
+        QString id;
+        Type type { Unknown };
+        Protocol::HData hdata;
+        Protocol::HashTable hashTable;
+        Protocol::String string;
+    };
+    struct Stats {
+        quint64 submitted { 0 };
+        quint64 delivered { 0 };
+        int inFlight { 0 };
+        int maxInFlight { 0 };
+        // how many times (and for how long) a submit had to wait because too many messages were in flight
+        quint64 stalls { 0 };
+        qint64 stalledMsecs { 0 };
+    };
+    // called from the worker threads with consecutive messages, in order, it shouldn't take long
+    using Sink = std::function<void(QList<Message> &&)>;
+
+    ParsePipeline();
+    ~ParsePipeline();
+
+    void setSink(const Sink &sink);
+
+    // both block while the pipeline is full, that's the backpressure to the socket
+    void submit(const QByteArray &data);
+    void submitParsed(Message &&message);
+    // forgets everything that wasn't delivered yet
+    void clear();
+
+    Stats stats() const;
+
+    static Message parse(const QByteArray &data);
+
+private:
+    quint64 reserve();
+    void complete(quint64 sequence, Message &&message);
+
+    // messages submitted but not delivered yet, including the ones waiting for their predecessors
+    static constexpr int c_maxInFlight { 64 };
+
+    QThreadPool m_pool;
+    Sink m_sink;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_notFull;
+    quint64 m_nextSequence { 0 };
+    quint64 m_nextDelivery { 0 };
+    QMap<quint64, Message> m_finished;
+    Stats m_stats;
+};
+
+#endif // PARSEPIPELINE_H
@@ -19,292 +19,465 @@
 
 #include "lith.h"
 
-#include <QDataStream>
 #include <QApplication>
 #include <QDateTime>
 #include <QAbstractEventDispatcher>
 #include <QStringLiteral>
+#include <QHash>
+#include <QtEndian>
+
+#include <cstring>
+#include <limits>
 
 namespace Protocol {
 
+QByteArrayView Cursor::read(qsizetype length) {
+    if (!m_ok || length < 0 || length > remaining()) {
+        m_ok = false;
+        m_pos = m_end;
+        return {};
+    }
+    QByteArrayView r(m_pos, length);
+    m_pos += length;
+    return r;
+}
+
+bool Cursor::readRaw(char *dest, qsizetype length) {
+    auto v = read(length);
+    if (!m_ok)
+        return false;
+    memcpy(dest, v.data(), length);
+    return true;
+}
+
+quint8 Cursor::readUInt8() {
+    auto v = read(1);
+    if (!m_ok)
+        return 0;
+    return static_cast<quint8>(v[0]);
+}
+
+quint32 Cursor::readUInt32() {
+    auto v = read(4);
+    if (!m_ok)
+        return 0;
+    return qFromBigEndian<quint32>(v.data());
+}
+
 template <>
-Char parse(QDataStream &s, bool *ok) {
-    Char r;
-    s.readRawData(&r, 1);
+Char parse(Cursor &s, bool *ok) {
+    Char r = 0;
+    s.readRaw(&r, 1);
     if (ok)
-        *ok = true;
+        *ok = s.ok();
     return r;
 }
 
 template <>
-Integer parse(QDataStream &s, bool *ok) {
-    Integer r;
-    s.setByteOrder(QDataStream::BigEndian);
-    s >> r;
+Integer parse(Cursor &s, bool *ok) {
+    Integer r = static_cast<Integer>(s.readUInt32());
     if (ok)
-        *ok = true;
+        *ok = s.ok();
     return r;
 }
 
+// Longs, pointers and times are sent as short ASCII numbers, these decode them straight from the message data
+static bool decodeDecimal(QByteArrayView text, qint64 &result) {
+    auto it = text.begin();
+    bool negative = false;
+    if (it != text.end() && (*it == '-' || *it == '+'))
+        negative = *it++ == '-';
+    if (it == text.end())
+        return false;
+    quint64 value = 0;
+    for (; it != text.end(); ++it) {
+        unsigned digit = static_cast<unsigned char>(*it) - '0';
+        if (digit > 9 || value > (std::numeric_limits<quint64>::max() - digit) / 10)
+            return false;
+        value = value * 10 + digit;
+    }
+    if (value > quint64(std::numeric_limits<qint64>::max()) + (negative ? 1 : 0))
+        return false;
+    result = negative ? qint64(0 - value) : qint64(value);
+    return true;
+}
+
+static bool decodeHex(QByteArrayView text, quint64 &result) {
+    if (text.startsWith("0x") || text.startsWith("0X"))
+        text = text.mid(2);
+    if (text.isEmpty() || text.size() > 16)
+        return false;
+    quint64 value = 0;
+    for (char c : text) {
+        unsigned digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return false;
+        value = (value << 4) | digit;
+    }
+    result = value;
+    return true;
+}
+
 template <>
-LongInteger parse(QDataStream &s, bool *ok) {
-    LongInteger r;
-    quint8 length;
-    s >> length;
-    QByteArray buf((int) length + 1, 0);
-    s.readRawData(buf.data(), length);
-    r = buf.toLongLong();
+LongInteger parse(Cursor &s, bool *ok) {
+    quint8 length = s.readUInt8();
+    auto buf = s.read(length);
+    LongInteger r = 0;
+    decodeDecimal(buf, r);
     if (ok)
-        *ok = true;
+        *ok = s.ok();
     return r;
 }
 
 template <>
-String parse(QDataStream &s, bool canContainHtml, bool *ok) {
+String parse(Cursor &s, bool canContainHtml, bool *ok) {
     String r;
-    uint32_t len;
-    r.clear();
-    s >> len;
+    uint32_t len = s.readUInt32();
     if (len == uint32_t(-1))
         r = String();
     else if (len == 0)
         r = "";
     else if (len > 0) {
-        QByteArray buf(len + 1, 0);
-        s.readRawData(buf.data(), len);
-        r = convertColorsToHtml(buf, canContainHtml);
+        auto buf = s.read(len);
+        // strings that can contain formatting are mostly message lines, a lot of which never get shown
+        // their decoding is deferred until the first time they're actually used
+        if (s.ok() && canContainHtml)
+            r = FormattedString::fromRaw(buf, canContainHtml);
+        else if (s.ok())
+            r = convertColorsToHtml(buf, canContainHtml);
     }
     if (ok)
-        *ok = true;
+        *ok = s.ok();
     return r;
 }
 
 template<>
-String parse(QDataStream &s, bool *ok) {
+String parse(Cursor &s, bool *ok) {
     return parse<String>(s, false, ok);
 }
 
 template <>
-Buffer parse(QDataStream &s, bool *ok) {
+Buffer parse(Cursor &s, bool *ok) {
     Buffer r;
-    uint32_t len;
-    r.clear();
-    s >> len;
+    uint32_t len = s.readUInt32();
     if (len == 0)
         r = "";
-    if (len > 0) {
-        r = QByteArray(len, 0);
-        s.readRawData(r.data(), len);
+    else if (len != uint32_t(-1)) {
+        auto buf = s.read(len);
+        r = QByteArray(buf.data(), buf.size());
     }
     if (ok)
-        *ok = true;
+        *ok = s.ok();
     return r;
 }
 
 template <>
-Pointer parse(QDataStream &s, bool *ok) {
-    Pointer r;
-    quint8 length;;
-    s >> length;
-    QByteArray buf((int) length + 1, 0);
-    s.readRawData(buf.data(), length);
-    bool parseOk = false;
-    r = buf.toULongLong(&parseOk, 16);
+Pointer parse(Cursor &s, bool *ok) {
+    quint8 length = s.readUInt8();
+    auto buf = s.read(length);
+    quint64 value = 0;
+    bool parseOk = decodeHex(buf, value);
+    Pointer r = value;
     if (ok)
-        *ok = parseOk;
+        *ok = parseOk && s.ok();
     return r;
 }
 
 template <>
-Time parse(QDataStream &s, bool *ok) {
-    Time r;
-    quint8 length;
-    s >> length;
-    QByteArray buf((int) length + 1, 0);
-    s.readRawData(buf.data(), length);
-    r = buf;
+Time parse(Cursor &s, bool *ok) {
+    quint8 length = s.readUInt8();
+    auto buf = s.read(length);
+    Time r = 0;
+    decodeDecimal(buf, r);
     if (ok)
-        *ok = true;
+        *ok = s.ok();
     return r;
 }
 
 template <>
-HashTable parse(QDataStream &s, bool *ok) {
+HashTable parse(Cursor &s, bool *ok) {
     HashTable r;
     char keyType[4] = { 0 }, valueType[4] = { 0 };
-    s.readRawData(keyType, 3);
+    s.readRaw(keyType, 3);
     if (QString(keyType) != "str") {
         qWarning() << "Hashtable currently supports only string keys";
         if (ok)
             *ok = false;
         return r;
     }
-    s.readRawData(valueType, 3);
+    s.readRaw(valueType, 3);
     if (QString(valueType) != "str") {
         qWarning() << "Hashtable currently supports only string values";
         if (ok)
             *ok = false;
         return r;
     }
-    quint32 count = 0;
-    s >> count;
+    quint32 count = s.readUInt32();
     r.clear();
-    for (quint32 i = 0; i < count; i++) {
+    for (quint32 i = 0; i < count && s.ok(); i++) {
         auto key = parse<String>(s);
         auto value = parse<String>(s);
         r.insert(key, value);
     }
     if (ok)
-        *ok = true;
+        *ok = s.ok();
     return r;
 }
 
-template <>
-HData parse(QDataStream &s, bool *outerOk) {
-    HData r;
-    bool innerOk = false;
-    String hpath = parse<String>(s, &innerOk);
-    if (!innerOk) {
-        if (outerOk)
-            *outerOk = false;
-        return r;
+static bool parseHDataHeader(Cursor &s, HData &r, Integer &count) {
+    bool ok = false;
+    String hpath = parse<String>(s, &ok);
+    if (!ok)
+        return false;
+    String keys = parse<String>(s, &ok);
+    if (!ok)
+        return false;
+    count = parse<Integer>(s, &ok);
+    if (!ok)
+        return false;
+    r.path = hpath.split("/");
+    r.keys = keys.split(",");
+    r.schema = HData::compileKeys(r.keys);
+    r.columns.resize(r.schema.count());
+    return true;
+}
+
+// tags don't contain any formatting, they're handed to Tags as they are in the message, without making strings first
+static Tags::Set parseTags(Cursor &s, bool *ok) {
+    Tags::Set r;
+    uint32_t len = s.readUInt32();
+    for (uint32_t i = 0; i < len && s.ok(); i++) {
+        uint32_t length = s.readUInt32();
+        if (length == 0 || length == uint32_t(-1))
+            continue;
+        auto buf = s.read(length);
+        if (s.ok())
+            r.add(buf);
     }
-    String keys = parse<String>(s, &innerOk);
-    if (!innerOk) {
-        if (outerOk)
-            *outerOk = false;
-        return r;
+    *ok = s.ok();
+    return r;
+}
+
+static void reserveRows(HData &r, int count) {
+    r.pointers.reserve(count * r.path.count());
+    for (int j = 0; j < r.schema.count(); j++) {
+        auto &column = r.columns[j];
+        switch (r.schema[j].type) {
+        case Type::Char: column.chars.reserve(count); break;
+        case Type::Integer: column.integers.reserve(count); break;
+        case Type::LongInteger: column.longIntegers.reserve(count); break;
+        case Type::String:
+        case Type::Buffer: column.strings.reserve(count); break;
+        case Type::Pointer: column.pointers.reserve(count); break;
+        case Type::Time: column.times.reserve(count); break;
+        case Type::HashTable: column.hashTables.reserve(count); break;
+        case Type::Array:
+            if (r.schema[j].field == Field::TagsArray)
+                column.tags.reserve(count);
+            else
+                column.arrays.reserve(count);
+            break;
+        case Type::Unknown: break;
+        }
     }
-    Integer count = parse<Integer>(s, &innerOk);
-    if (!innerOk) {
-        if (outerOk)
-            *outerOk = false;
-        return r;
+}
+
+// drops everything after the first "rows" rows, used to get rid of a partially parsed row
+static void truncateRows(HData &r, int rows) {
+    r.rows = rows;
+    r.pointers.resize(rows * r.path.count());
+    for (int j = 0; j < r.schema.count(); j++) {
+        auto &column = r.columns[j];
+        switch (r.schema[j].type) {
+        case Type::Char: column.chars.resize(rows); break;
+        case Type::Integer: column.integers.resize(rows); break;
+        case Type::LongInteger: column.longIntegers.resize(rows); break;
+        case Type::String:
+        case Type::Buffer: column.strings.resize(rows); break;
+        case Type::Pointer: column.pointers.resize(rows); break;
+        case Type::Time: column.times.resize(rows); break;
+        case Type::HashTable: column.hashTables.resize(rows); break;
+        case Type::Array:
+            if (r.schema[j].field == Field::TagsArray)
+                column.tags.resize(rows);
+            else
+                column.arrays.resize(rows);
+            break;
+        case Type::Unknown: break;
+        }
     }
-    r.path = hpath.split("/");
-    r.keys = keys.split(",");
+}
 
-    for (int i = 0; i < count; i++) {
-        HData::Item item;
-        for (int j = 0; j < r.path.count(); j++) {
-            Pointer ptr = parse<Pointer>(s, &innerOk);
-            if (!innerOk) {
-                if (outerOk)
-                    *outerOk = false;
-                return r;
-            }
-            item.pointers.append(ptr);
+// parses a single row, if it's not complete, the row is dropped and false is returned
+static bool parseHDataRow(Cursor &s, HData &r) {
+    bool innerOk = false;
+    for (int j = 0; j < r.path.count(); j++) {
+        Pointer ptr = parse<Pointer>(s, &innerOk);
+        if (!innerOk) {
+            truncateRows(r, r.rows);
+            return false;
         }
-        for (int j = 0; j < r.keys.count(); j++) {
-            auto name = r.keys[j].split(":").first();
-            auto type = r.keys[j].split(":").last();
-            if (type == "int") {
-                Integer i = parse<Integer>(s, &innerOk);
-                if (!innerOk) {
-                    if (outerOk)
-                        *outerOk = false;
-                    return r;
-                }
-                item.objects[name] = QVariant::fromValue(i);
-            }
-            else if (type == "lon") {
-                LongInteger l = parse<LongInteger>(s, &innerOk);
-                if (!innerOk) {
-                    if (outerOk)
-                        *outerOk = false;
-                    return r;
-                }
-                item.objects[name] = QVariant::fromValue(l);
-            }
-            else if (type == "str" || type == "buf") {
-                bool canContainHTML = false;
-                if (name == "message" || name == "title" || name == "prefix")
-                    canContainHTML = true;
-                String str = parse<String>(s, canContainHTML, &innerOk);
-                if (!innerOk) {
-                    if (outerOk)
-                        *outerOk = false;
-                    return r;
-                }
-                item.objects[name] = QVariant::fromValue(str);
-            }
-            else if (type == "arr") {
-                char fieldType[4] = { 0 };
-                s.readRawData(fieldType, 3);
-                if (strcmp(fieldType, "int") == 0) {
-                    ArrayInt a = parse<ArrayInt>(s, &innerOk);
-                    if (!innerOk) {
-                        if (outerOk)
-                            *outerOk = false;
-                        return r;
-                    }
-                    item.objects[name] = QVariant::fromValue(a);
-                }
-                else if (strcmp(fieldType, "str") == 0) {
-                    ArrayStr a = parse<ArrayStr>(s, &innerOk);
-                    if (!innerOk) {
-                        if (outerOk)
-                            *outerOk = false;
-                        return r;
-                    }
-                    item.objects[name] = QVariant::fromValue(a);
+        r.pointers.append(ptr);
+    }
+    for (int j = 0; j < r.schema.count(); j++) {
+        const auto &key = r.schema[j];
+        auto &column = r.columns[j];
+        switch (key.type) {
+        case Type::Integer:
+            column.integers.append(parse<Integer>(s, &innerOk));
+            break;
+        case Type::LongInteger:
+            column.longIntegers.append(parse<LongInteger>(s, &innerOk));
+            break;
+        case Type::String:
+        case Type::Buffer:
+            column.strings.append(parse<String>(s, key.canContainHtml, &innerOk));
+            break;
+        case Type::Array: {
+            char fieldType[4] = { 0 };
+            s.readRaw(fieldType, 3);
+            if (key.field == Field::TagsArray) {
+                if (strcmp(fieldType, "str") == 0) {
+                    column.tags.append(parseTags(s, &innerOk));
                 }
                 else {
-                    qCritical() << "Unhandled array item type:" << fieldType << "for field" << name;
+                    innerOk = s.ok();
+                    if (innerOk)
+                        qCritical() << "Unhandled array item type:" << fieldType << "for field" << key.name;
+                    column.tags.append(Tags::Set());
                 }
             }
-            else if (type == "tim") {
-                Time t = parse<Time>(s, &innerOk);
-                if (!innerOk) {
-                    if (outerOk)
-                        *outerOk = false;
-                    return r;
-                }
-                item.objects[name] = QVariant::fromValue(QDateTime::fromSecsSinceEpoch(t.toLocal8Bit().toULongLong(nullptr, 10)));
-            }
-            else if (type == "ptr") {
-                Pointer p = parse<Pointer>(s, &innerOk);
-                if (!innerOk) {
-                    if (outerOk)
-                        *outerOk = false;
-                    return r;
-                }
-                item.objects[name] = QVariant::fromValue(p);
+            else if (strcmp(fieldType, "int") == 0) {
+                column.arrays.append(QVariant::fromValue(parse<ArrayInt>(s, &innerOk)));
             }
-            else if (type == "chr") {
-                Char c = parse<Char>(s, &innerOk);
-                if (!innerOk) {
-                    if (outerOk)
-                        *outerOk = false;
-                    return r;
-                }
-                item.objects[name] = QVariant::fromValue(c);
-            }
-            else if (type == "htb") {
-                HashTable htb = parse<HashTable>(s, &innerOk);
-                if (!innerOk) {
-                    if (outerOk)
-                        *outerOk = false;
-                    return r;
-                }
-                item.objects[name] = QVariant::fromValue(htb);
+            else if (strcmp(fieldType, "str") == 0) {
+                column.arrays.append(QVariant::fromValue(parse<ArrayStr>(s, &innerOk)));
             }
             else {
-                qCritical() << "!!! Unhandled type:" << type << "for field" << name;
+                innerOk = s.ok();
+                if (innerOk)
+                    qCritical() << "Unhandled array item type:" << fieldType << "for field" << key.name;
+                // keep the column aligned with the rows
+                column.arrays.append(QVariant());
             }
+            break;
+        }
+        case Type::Time:
+            column.times.append(parse<Time>(s, &innerOk));
+            break;
+        case Type::Pointer:
+            column.pointers.append(parse<Pointer>(s, &innerOk));
+            break;
+        case Type::Char:
+            column.chars.append(parse<Char>(s, &innerOk));
+            break;
+        case Type::HashTable:
+            column.hashTables.append(parse<HashTable>(s, &innerOk));
+            break;
+        case Type::Unknown:
+            // already reported when compiling the keys
+            continue;
+        }
+        if (!innerOk) {
+            truncateRows(r, r.rows);
+            return false;
+        }
+    }
+    r.rows++;
+    return true;
+}
+
+template <>
+HData parse(Cursor &s, bool *outerOk) {
+    HData r;
+    Integer count = 0;
+    if (!parseHDataHeader(s, r, count)) {
+        if (outerOk)
+            *outerOk = false;
+        return r;
+    }
+    reserveRows(r, count);
+    for (int i = 0; i < count; i++) {
+        if (!parseHDataRow(s, r)) {
+            if (outerOk)
+                *outerOk = false;
+            return r;
         }
-        r.data.append(item);
     }
     if (outerOk)
         *outerOk = true;
     return r;
 }
 
+void StreamParser::reset() {
+    *this = StreamParser();
+}
+
+void StreamParser::append(const QByteArray &data) {
+    m_buffer.append(data);
+    if (!m_headerReady)
+        parseHeader();
+}
+
+void StreamParser::parseHeader() {
+    Cursor s(m_buffer);
+    bool ok = false;
+    String id = parse<String>(s, &ok);
+    char type[4] = { 0 };
+    if (!ok || !s.readRaw(type, 3))
+        return;
+    if (strcmp(type, "hda") == 0) {
+        HData header;
+        Integer count = 0;
+        if (!parseHDataHeader(s, header, count))
+            return;
+        m_pending = header;
+        m_count = count;
+        m_isHData = true;
+        m_offset = s.position() - m_buffer.constData();
+    }
+    m_id = id;
+    m_headerReady = true;
+}
+
+void StreamParser::parseRows(int maxRows) {
+    if (!m_headerReady || !m_isHData)
+        return;
+    Cursor s(QByteArrayView(m_buffer).mid(m_offset));
+    while (m_parsedRows < m_count && m_pending.count() < maxRows) {
+        // an incomplete row is dropped and parsed again once more data comes in
+        if (!parseHDataRow(s, m_pending))
+            break;
+        m_parsedRows++;
+        m_offset = s.position() - m_buffer.constData();
+    }
+    // the parsed rows aren't needed anymore, don't keep the whole message around
+    if (m_offset > m_buffer.size() / 2) {
+        m_buffer.remove(0, m_offset);
+        m_offset = 0;
+    }
+}
+
+HData StreamParser::takePending() {
+    HData result = m_pending;
+    m_pending = HData();
+    m_pending.path = result.path;
+    m_pending.keys = result.keys;
+    m_pending.schema = result.schema;
+    m_pending.columns.resize(result.schema.count());
+    return result;
+}
+
 template <>
-ArrayInt parse(QDataStream &s, bool *outerOk) {
+ArrayInt parse(Cursor &s, bool *outerOk) {
     ArrayInt r;
-    uint32_t len;
-    s >> len;
+    uint32_t len = s.readUInt32();
     for (uint32_t i = 0; i < len; i++) {
         bool innerOk = false;
         Integer num = parse<Integer>(s, &innerOk);
@@ -321,10 +494,9 @@ ArrayInt parse(QDataStream &s, bool *outerOk) {
 }
 
 template <>
-ArrayStr parse(QDataStream &s, bool *outerOk) {
+ArrayStr parse(Cursor &s, bool *outerOk) {
     ArrayStr r;
-    uint32_t len;
-    s >> len;
+    uint32_t len = s.readUInt32();
     for (uint32_t i = 0; i < len; i++) {
         bool innerOk = false;
         String str = parse<String>(s, &innerOk);
@@ -340,9 +512,42 @@ ArrayStr parse(QDataStream &s, bool *outerOk) {
     return r;
 }
 
-FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml) {
+static inline bool isFormattingByte(char c) {
+    return c == 0 || (c >= 0x19 && c <= 0x1C);
+}
+
+// Looks for the next byte convertColorsToHtml has to handle, checking a whole word at a time.
+// None of these bytes can be part of a multibyte UTF-8 sequence so the text in between is safe to decode at once
+static const char *findFormattingByte(const char *it, const char *end) {
+    constexpr quint64 ones = 0x0101010101010101ULL;
+    constexpr quint64 highBits = 0x8080808080808080ULL;
+    while (end - it >= 8) {
+        quint64 word;
+        memcpy(&word, it, sizeof(word));
+        // nonzero if any of the bytes is below 0x1D, that's all the formatting codes but also tabs and such
+        if ((word - ones * 0x1D) & ~word & highBits) {
+            for (int i = 0; i < 8; i++) {
+                if (isFormattingByte(it[i]))
+                    return it + i;
+            }
+        }
+        it += 8;
+    }
+    while (it < end && !isFormattingByte(*it))
+        ++it;
+    return it;
+}
+
+FormattedString convertColorsToHtml(QByteArrayView data, bool canContainHtml) {
     FormattedString result;
 
+    // the data is a view into the whole message frame, there's no terminating zero to stop at
+    // so anything that would read past the end of the string gets a zero instead
+    const char *end = data.end();
+    auto at = [end](QByteArrayView::const_iterator it) -> char {
+        return it < end ? *it : 0;
+    };
+
     FormattedString::Part::Color foregroundColor;
     bool foreground = false;
     FormattedString::Part::Color backgroundColor;
@@ -398,9 +603,9 @@ FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml)
        }
        carryOver();
     };
-    auto loadAttr = [&carryOver, &bold, &reverse, &italic, &underline, &keep](QByteArray::const_iterator &it) {
+    auto loadAttr = [&carryOver, &bold, &reverse, &italic, &underline, &keep, at](QByteArrayView::const_iterator &it) {
        while (true) {
-           switch(*it) {
+           switch(at(it)) {
            case 0x01: // fallthrough // TODO what the fuck weechat
            case '*':
                if (bold)
@@ -443,9 +648,9 @@ FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml)
        }
     };
 
-    auto clearAttr = [&carryOver, &bold, &reverse, &italic, &underline, &keep](QByteArray::const_iterator &it) {
+    auto clearAttr = [&carryOver, &bold, &reverse, &italic, &underline, &keep, at](QByteArrayView::const_iterator &it) {
        while (true) {
-           switch(*it) {
+           switch(at(it)) {
            case 0x01: // fallthrough // TODO what the fuck weechat
            case '*':
                if (bold) {
@@ -485,15 +690,15 @@ FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml)
            ++it;
        }
     };
-    auto loadStd = [&carryOver, &foreground, &foregroundColor](QByteArray::const_iterator &it) {
-       while (*it == '@' || *it == '*' || *it == '!' || *it == '/' || *it == '_' || *it == '|')
+    auto loadStd = [&carryOver, &foreground, &foregroundColor, at](QByteArrayView::const_iterator &it) {
+       while (at(it) == '@' || at(it) == '*' || at(it) == '!' || at(it) == '/' || at(it) == '_' || at(it) == '|')
            ++it;
        int code = 0;
-       if (*it == 0x19 || *it == 'F')
+       if (at(it) == 0x19 || at(it) == 'F')
            it++;
        for (int i = 0; i < 2; i++) {
            code *= 10;
-           code += (*it) - '0';
+           code += (at(it)) - '0';
            ++it;
        }
        --it;
@@ -512,13 +717,13 @@ FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml)
        }
        carryOver();
     };
-    auto loadExt = [&carryOver, &foreground, &foregroundColor](QByteArray::const_iterator &it) {
-        while (*it == '@' || *it == '*' || *it == '!' || *it == '/' || *it == '_' || *it == '|')
+    auto loadExt = [&carryOver, &foreground, &foregroundColor, at](QByteArrayView::const_iterator &it) {
+        while (at(it) == '@' || at(it) == '*' || at(it) == '!' || at(it) == '/' || at(it) == '_' || at(it) == '|')
            ++it;
         int code = 0;
         for (int i = 0; i < 5; i++) {
            code *= 10;
-           code += (*it) - '0';
+           code += (at(it)) - '0';
            ++it;
         }
         --it;
@@ -532,13 +737,13 @@ FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml)
         }
         carryOver();
     };
-    auto loadBgStd = [&carryOver, &background, &backgroundColor](QByteArray::const_iterator &it) {
-       while (*it == '@' || *it == '*' || *it == '!' || *it == '/' || *it == '_' || *it == '|' || *it == ',' || *it == '~')
+    auto loadBgStd = [&carryOver, &background, &backgroundColor, at](QByteArrayView::const_iterator &it) {
+       while (at(it) == '@' || at(it) == '*' || at(it) == '!' || at(it) == '/' || at(it) == '_' || at(it) == '|' || at(it) == ',' || at(it) == '~')
            ++it;
        int code = 0;
        for (int i = 0; i < 2; i++) {
            code *= 10;
-           code += (*it) - '0';
+           code += (at(it)) - '0';
            ++it;
        }
        --it;
@@ -557,13 +762,13 @@ FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml)
        }
        carryOver();
     };
-    auto loadBgExt = [&carryOver, &background, &backgroundColor](QByteArray::const_iterator &it) {
-       while (*it == '@' || *it == '*' || *it == '!' || *it == '/' || *it == '_' || *it == '|' || *it == ',' || *it == '~')
+    auto loadBgExt = [&carryOver, &background, &backgroundColor, at](QByteArrayView::const_iterator &it) {
+       while (at(it) == '@' || at(it) == '*' || at(it) == '!' || at(it) == '/' || at(it) == '_' || at(it) == '|' || at(it) == ',' || at(it) == '~')
            ++it;
        int code = 0;
        for (int i = 0; i < 5; i++) {
            code *= 10;
-           code += (*it) - '0';
+           code += (at(it)) - '0';
            ++it;
        }
        --it;
@@ -577,39 +782,12 @@ FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml)
        }
        carryOver();
     };
-    auto getChar = [](QByteArray::const_iterator &it) -> QString {
-       if ((unsigned char) *it < 0x80) {
-           return QString(*it);
-       }
-       else {
-           QByteArray buf;
-           if ((*it & 0b11111000) == 0b11110000) {
-               buf += *it++;
-               buf += *it++;
-               buf += *it++;
-               buf += *it;
-           }
-           else if ((*it & 0b11110000) == 0b11100000) {
-               buf += *it++;
-               buf += *it++;
-               buf += *it;
-           }
-           else if ((*it & 0b11100000) == 0b11000000) {
-               buf += *it++;
-               buf += *it;
-           }
-           else {
-               return QString(*it);
-           }
-           return QString(buf);
-       }
-    };
-    for (auto it = data.begin(); it != data.end(); ++it) {
-       if (*it == 0x19) {
+    for (auto it = data.begin(); it < end; ++it) {
+       if (at(it) == 0x19) {
            ++it;
-           if (*it == 'F') {
+           if (at(it) == 'F') {
                ++it;
-               if (*it == '@') {
+               if (at(it) == '@') {
                    ++it;
                    loadAttr(it);
                    loadExt(it);
@@ -619,16 +797,16 @@ FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml)
                    loadStd(it);
                }
            }
-           else if (*it == 'B') {
+           else if (at(it) == 'B') {
                ++it;
-               if (*it == '@')
+               if (at(it) == '@')
                    loadBgExt(it);
                else
                    loadBgStd(it);
            }
-           else if (*it == '*') {
+           else if (at(it) == '*') {
                ++it;
-               if (*it == '@') {
+               if (at(it) == '@') {
                    ++it;
                    loadAttr(it);
                    loadExt(it);
@@ -638,9 +816,9 @@ FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml)
                    loadStd(it);
                }
                ++it;
-               if (*it == ',' || *it == '~') {
+               if (at(it) == ',' || at(it) == '~') {
                    ++it;
-                   if (*it == '@') {
+                   if (at(it) == '@') {
                        ++it;
                        loadAttr(it);
                        loadBgExt(it);
@@ -654,29 +832,32 @@ FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml)
                    --it;
                }
            }
-           else if (*it == '@') {
+           else if (at(it) == '@') {
                ++it;
                loadExt(it);
            }
-           else if (*it == 0x1C) {
+           else if (at(it) == 0x1C) {
                endColors();
            }
            else {
                loadStd(it);
            }
        }
-       else if (*it == 0x1C) {
+       else if (at(it) == 0x1C) {
            endColors();
            endAttrs();
        }
-       else if (*it == 0x1A) {
+       else if (at(it) == 0x1A) {
            loadAttr(it);
        }
-       else if (*it == 0x1B) {
+       else if (at(it) == 0x1B) {
            clearAttr(it);
        }
-       else if (*it) {
-           result += getChar(it);
+       else if (at(it)) {
+           // everything up to the next formatting code is plain text, decode it in one go
+           auto runEnd = findFormattingByte(it, end);
+           result += QString::fromUtf8(it, runEnd - it);
+           it = runEnd - 1;
        }
     }
     endColors();
@@ -687,6 +868,133 @@ FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHtml)
     return result;
 }
 
+static Type typeFromName(QStringView name) {
+    static const QHash<QString, Type> types {
+        { "chr", Type::Char },
+        { "int", Type::Integer },
+        { "lon", Type::LongInteger },
+        { "str", Type::String },
+        { "buf", Type::Buffer },
+        { "ptr", Type::Pointer },
+        { "tim", Type::Time },
+        { "htb", Type::HashTable },
+        { "arr", Type::Array },
+    };
+    return types.value(name.toString(), Type::Unknown);
+}
+
+static Field fieldFromName(QStringView name) {
+    static const QHash<QString, Field> fields {
+        { "buffer", Field::Buffer },
+        { "date", Field::Date },
+        { "date_printed", Field::DatePrinted },
+        { "displayed", Field::Displayed },
+        { "highlight", Field::Highlight },
+        { "tags_array", Field::TagsArray },
+        { "prefix", Field::Prefix },
+        { "message", Field::Message },
+        { "number", Field::Number },
+        { "name", Field::Name },
+        { "short_name", Field::ShortName },
+        { "full_name", Field::FullName },
+        { "hidden", Field::Hidden },
+        { "title", Field::Title },
+        { "local_variables", Field::LocalVariables },
+        { "count", Field::Count },
+        { "_diff", Field::Diff },
+        { "visible", Field::Visible },
+        { "group", Field::Group },
+        { "level", Field::Level },
+        { "color", Field::Color },
+        { "prefix_color", Field::PrefixColor },
+    };
+    return fields.value(name.toString(), Field::Unknown);
+}
+
+QList<HData::Key> HData::compileKeys(const QStringList &keys) {
+    QList<Key> result;
+    result.reserve(keys.count());
+    for (const auto &i : keys) {
+        if (i.isEmpty())
+            continue;
+        auto separator = i.indexOf(':');
+        Key key;
+        key.name = i.left(separator);
+        key.property = key.name.toLatin1();
+        key.field = fieldFromName(key.name);
+        key.type = typeFromName(QStringView(i).mid(separator + 1));
+        key.canContainHtml = key.field == Field::Message || key.field == Field::Title || key.field == Field::Prefix;
+        if (key.type == Type::Unknown)
+            qCritical() << "!!! Unhandled type:" << i.mid(separator + 1) << "for field" << key.name;
+        result.append(key);
+    }
+    return result;
+}
+
+int HData::columnIndex(Field field) const {
+    for (int i = 0; i < schema.count(); i++) {
+        if (schema[i].field == field)
+            return i;
+    }
+    return -1;
+}
+
+int HData::columnIndex(const QString &name) const {
+    for (int i = 0; i < schema.count(); i++) {
+        if (schema[i].name == name)
+            return i;
+    }
+    return -1;
+}
+
+QVariant HData::value(int row, int column) const {
+    const auto &c = columns[column];
+    switch (schema[column].type) {
+    case Type::Char:
+        return QVariant::fromValue(c.chars[row]);
+    case Type::Integer:
+        return QVariant::fromValue(c.integers[row]);
+    case Type::LongInteger:
+        return QVariant::fromValue(c.longIntegers[row]);
+    case Type::String:
+    case Type::Buffer:
+        return QVariant::fromValue(c.strings[row]);
+    case Type::Pointer:
+        return QVariant::fromValue(c.pointers[row]);
+    case Type::Time:
+        return QDateTime::fromSecsSinceEpoch(c.times[row]);
+    case Type::HashTable:
+        return QVariant::fromValue(c.hashTables[row]);
+    case Type::Array:
+        if (schema[column].field == Field::TagsArray)
+            return c.tags[row].names();
+        return c.arrays[row];
+    case Type::Unknown:
+        break;
+    }
+    return QVariant();
+}
+
+HData::Item HData::item(int row) const {
+    Item result;
+    for (int i = 0; i < path.count(); i++)
+        result.pointers.append(pointer(row, i));
+    for (int i = 0; i < schema.count(); i++) {
+        auto v = value(row, i);
+        if (v.isValid())
+            result.objects[schema[i].name] = v;
+    }
+    return result;
+}
+
+QList<HData::Item> HData::items() const {
+    QList<Item> result;
+    result.reserve(rows);
+    for (int i = 0; i < rows; i++)
+        result.append(item(i));
+    return result;
+}
+
 QString HData::toString() const {
     QString ret;
 
@@ -700,7 +1008,7 @@ QString HData::toString() const {
         ret += "\t" + i + "\n";
     }
     ret += "-VALUES:\n";
-    for (auto i : data) {
+    for (auto i : items()) {
         ret += "\t-PATH\n";
         ret += "\t\t";
         for (auto j : i.pointers) {
@@ -18,48 +18,190 @@
 #define PROTOCOL_H
 
 #include "common.h"
+#include "util/tags.h"
+
+#include <QByteArrayView>
+#include <QDateTime>
 
 namespace Protocol {
+    // Walks a single (already decompressed) message frame without copying it.
+    // Everything read through the cursor is a view into the original buffer which has to outlive it.
+    class Cursor {
+    public:
+        Cursor(QByteArrayView data)
+            : m_pos(data.data())
+            , m_end(data.data() + data.size())
+        {}
+
+        bool ok() const { return m_ok; }
+        bool atEnd() const { return m_pos >= m_end; }
+        const char *position() const { return m_pos; }
+        qsizetype remaining() const { return m_end - m_pos; }
+
+        QByteArrayView read(qsizetype length);
+        bool readRaw(char *dest, qsizetype length);
+        quint8 readUInt8();
+        quint32 readUInt32();
+
+    private:
+        const char *m_pos { nullptr };
+        const char *m_end { nullptr };
+        bool m_ok { true };
+    };
+
     using Char = char;
     using Integer = qint32;
     using LongInteger = qint64;
     using String = FormattedString;
     using Buffer = QByteArray;
     using Pointer = pointer_t;
-    using Time = QString;
+    // seconds since epoch, converted to a QDateTime only when something needs it
+    using Time = qint64;
     using HashTable = StringMap;
+
+    enum class Type : quint8 {
+        Unknown,
+        Char,
+        Integer,
+        LongInteger,
+        String,
+        Buffer,
+        Pointer,
+        Time,
+        HashTable,
+        Array
+    };
+
+    // HData fields Lith knows about, anything else is Unknown and gets handled only by its name
+    enum class Field : quint8 {
+        Unknown,
+        Buffer,
+        Date,
+        DatePrinted,
+        Displayed,
+        Highlight,
+        TagsArray,
+        Prefix,
+        Message,
+        Number,
+        Name,
+        ShortName,
+        FullName,
+        Hidden,
+        Title,
+        LocalVariables,
+        Count,
+        Diff,
+        Visible,
+        Group,
+        Level,
+        Color,
+        PrefixColor
+    };
+
     struct HData {
+        // compatibility row representation, handlers that haven't been moved to the columns use items()
         struct Item {
             QList<Pointer> pointers;
             QMap<QString,QVariant> objects;
         };
+        // one entry of the "keys" header, compiled once per message
+        struct Key {
+            QString name;
+            QByteArray property;
+            Field field { Field::Unknown };
+            Type type { Type::Unknown };
+            bool canContainHtml { false };
+        };
+        // values of one key for all rows, only the list matching the type of the key is filled
+        struct Column {
+            QList<Char> chars;
+            QList<Integer> integers;
+            QList<LongInteger> longIntegers;
+            QList<String> strings;
+            QList<Pointer> pointers;
+            QList<Time> times;
+            QList<HashTable> hashTables;
+            QList<QVariant> arrays;
+            // tags_array doesn't go through arrays, the tags are interned as they're parsed
+            QList<Tags::Set> tags;
+        };
 
         QStringList keys;
         QStringList path;
-        QList<Item> data;
+        QList<Key> schema;
+        QList<Column> columns;
+        // path pointers of all rows, path.count() of them per row
+        QList<Pointer> pointers;
+        int rows { 0 };
+
+        static QList<Key> compileKeys(const QStringList &keys);
+
+        int count() const { return rows; }
+        int columnIndex(Field field) const;
+        int columnIndex(const QString &name) const;
+        Pointer pointer(int row, int depth) const { return pointers[row * path.count() + depth]; }
+        Pointer firstPointer(int row) const { return pointer(row, 0); }
+        Pointer lastPointer(int row) const { return pointer(row, path.count() - 1); }
+        QVariant value(int row, int column) const;
+
+        Item item(int row) const;
+        QList<Item> items() const;
 
         QString toString() const;
     };
     using ArrayInt = QList<int>;
     using ArrayStr = QStringList;
 
-    template <typename T> T parse(QDataStream &s, bool canContainHtml, bool *ok = nullptr);
-    template <typename T> T parse(QDataStream &s, bool *ok = nullptr);
-
-    template <> Char parse(QDataStream &s, bool *ok);
-    template <> Integer parse(QDataStream &s, bool *ok);
-    template <> LongInteger parse(QDataStream &s, bool *ok);
-    template <> String parse(QDataStream &s, bool canContainHTML, bool *ok);
-    template <> String parse(QDataStream &s, bool *ok);
-    template <> Buffer parse(QDataStream &s, bool *ok);
-    template <> Pointer parse(QDataStream &s, bool *ok);
-    template <> Time parse(QDataStream &s, bool *ok);
-    template <> HashTable parse(QDataStream &s, bool *ok);
-    template <> HData parse(QDataStream &s, bool *ok);
-    template <> ArrayInt parse(QDataStream &s, bool *ok);
-    template <> ArrayStr parse(QDataStream &s, bool *ok);
-
-    FormattedString convertColorsToHtml(const QByteArray &data, bool canContainHTML);
+    template <typename T> T parse(Cursor &s, bool canContainHtml, bool *ok = nullptr);
+    template <typename T> T parse(Cursor &s, bool *ok = nullptr);
+
+    template <> Char parse(Cursor &s, bool *ok);
+    template <> Integer parse(Cursor &s, bool *ok);
+    template <> LongInteger parse(Cursor &s, bool *ok);
+    template <> String parse(Cursor &s, bool canContainHTML, bool *ok);
+    template <> String parse(Cursor &s, bool *ok);
+    template <> Buffer parse(Cursor &s, bool *ok);
+    template <> Pointer parse(Cursor &s, bool *ok);
+    template <> Time parse(Cursor &s, bool *ok);
+    template <> HashTable parse(Cursor &s, bool *ok);
+    template <> HData parse(Cursor &s, bool *ok);
+    template <> ArrayInt parse(Cursor &s, bool *ok);
+    template <> ArrayStr parse(Cursor &s, bool *ok);
+
+    // Decodes a message while its frame is still being received. The id and type are known as soon as
+    // they arrive and rows of a hda message can be taken out in batches before the rest of it is there.
+    class StreamParser {
+    public:
+        void reset();
+        void append(const QByteArray &data);
+
+        bool headerReady() const { return m_headerReady; }
+        bool isHData() const { return m_isHData; }
+        const QString &id() const { return m_id; }
+        // everything received so far, only complete if parseRows was never called
+        const QByteArray &data() const { return m_buffer; }
+
+        // parses complete rows until maxRows of them are pending or the data runs out
+        void parseRows(int maxRows);
+        int pendingRows() const { return m_pending.count(); }
+        bool allRowsParsed() const { return m_headerReady && m_isHData && m_parsedRows >= m_count; }
+        HData takePending();
+
+    private:
+        void parseHeader();
+
+        QByteArray m_buffer;
+        qsizetype m_offset { 0 };
+        bool m_headerReady { false };
+        bool m_isHData { false };
+        QString m_id;
+        HData m_pending;
+        Integer m_count { 0 };
+        Integer m_parsedRows { 0 };
+    };
+
+    FormattedString convertColorsToHtml(QByteArrayView data, bool canContainHTML);
 };
 
 Q_DECLARE_METATYPE(Protocol::HData);
@@ -3,6 +3,8 @@
 #include <QQmlEngine>
 #include <QDebug>
 
+#include <algorithm>
+
 #define ValidateIndex(m_i) (m_i < 0 || m_i >= rowCount())
 
 void QmlObjectList::append(const QVariantMap& properties)
@@ -26,6 +28,10 @@ void QmlObjectList::prepend(QObject *object) {
     endInsertRows();
 }
 
+void QmlObjectList::prepend(const QList<QObject*> &objects) {
+    insert(0, objects);
+}
+
 void QmlObjectList::append(QObject *object)
 {
     insert(rowCount(), object);
@@ -42,6 +48,32 @@ bool QmlObjectList::insert(const int& i, QObject* object)
     return true;
 }
 
+bool QmlObjectList::insert(const int &i, const QList<QObject*> &objects) {
+    if (i < 0 || i > rowCount())
+        return false;
+    if (objects.isEmpty())
+        return true;
+    QList<QObjectPointer> pointers;
+    pointers.reserve(objects.count());
+    for (auto object : objects) {
+        Q_ASSERT(object->metaObject() == &mMetaObject);
+        pointers.append(QObjectPointer(object));
+    }
+    beginInsertRows(QModelIndex(), i, i + objects.count() - 1);
+    mData.insert(i, objects.count(), QObjectPointer());
+    std::move(pointers.begin(), pointers.end(), mData.begin() + i);
+    endInsertRows();
+    return true;
+}
+
+int QmlObjectList::indexOf(QObject *object) const {
+    for (int i = 0; i < mData.count(); i++) {
+        if (mData[i] == object)
+            return i;
+    }
+    return -1;
+}
+
 int QmlObjectList::count() {
     return rowCount();
 }
@@ -58,6 +90,16 @@ bool QmlObjectList::removeRow(int row, const QModelIndex &parent)
     return true;
 }
 
+bool QmlObjectList::removeRows(int row, int count, const QModelIndex &parent)
+{
+    if (count <= 0 || ValidateIndex(row) || ValidateIndex(row + count - 1))
+        return false;
+    beginRemoveRows(parent, row, row + count - 1);
+    mData.remove(row, count);
+    endRemoveRows();
+    return true;
+}
+
 bool QmlObjectList::removeItem(QObject *item) {
     for (int i = 0; i < mData.count(); i++) {
         if (mData[i] == item) {
@@ -22,9 +22,15 @@ public:
     }
 
     void prepend(QObject* object);
+    // inserts all of them at once, the first one ends up on top
+    void prepend(const QList<QObject*> &objects);
     void append(QObject *object);
 
     bool insert(const int& i, QObject *object);
+    // inserts all of them as a single row range, the first one ends up at i
+    bool insert(const int& i, const QList<QObject*> &objects);
+
+    int indexOf(QObject *object) const;
 
     int count();
 
@@ -42,6 +48,7 @@ public:
     void append(const QVariantMap& properties);
 
     Q_INVOKABLE bool removeRow(int row, const QModelIndex &parent = QModelIndex());
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
 
     Q_INVOKABLE bool removeItem(QObject *item);
 
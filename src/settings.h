@@ -77,10 +77,17 @@ class Settings : public QObject {
     SETTING(QString, passphrase)
     SETTING(bool, handshakeAuth, false)
     SETTING(bool, connectionCompression, true)
+    // "zstd" or "zlib", zstd falls back to zlib if WeeChat (older than 3.5) or this build doesn't support it
+    SETTING(QString, connectionCompressionCodec, "zstd")
 #ifndef __EMSCRIPTEN__
     SETTING(bool, useWebsockets, false)
 #endif // __EMSCRIPTEN__
     SETTING(QString, websocketsEndpoint, "weechat")
+    // rows of big messages are passed to the UI in batches of this size while they're still being received
+    SETTING(int, streamingBatchSize, 250)
+    // lines kept in memory, the oldest ones in buffers that aren't open get dropped and fetched again when scrolled to
+    SETTING(int, linesPerBuffer, 2000)
+    SETTING(int, linesTotal, 50000)
 
     SETTING(bool, enableReadlineShortcuts, true)
     SETTING(QStringList, shortcutSearchBuffer, {"Alt+G"})
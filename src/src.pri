@@ -0,0 +1,60 @@
+# everything except main.cpp, shared by the app and the tools that link its code
+
+HEADERS += \
+    $$PWD/clipboardproxy.h \
+    $$PWD/datamodel.h \
+    $$PWD/lith.h \
+    $$PWD/protocol.h \
+    $$PWD/qmlobjectlist.h \
+    $$PWD/settings.h \
+    $$PWD/uploader.h \
+    $$PWD/util/formattedstring.h \
+    $$PWD/util/messagelistfilter.h \
+    $$PWD/util/nicklistfilter.h \
+    $$PWD/weechat.h \
+    $$PWD/parsepipeline.h \
+    $$PWD/common.h \
+    $$PWD/windowhelper.h \
+    $$PWD/util/capture.h \
+    $$PWD/util/colortheme.h \
+    $$PWD/util/decompressor.h \
+    $$PWD/util/sockethelper.h \
+    $$PWD/util/tags.h
+
+SOURCES += \
+    $$PWD/lith.cpp \
+    $$PWD/clipboardproxy.cpp \
+    $$PWD/datamodel.cpp \
+    $$PWD/protocol.cpp \
+    $$PWD/qmlobjectlist.cpp \
+    $$PWD/settings.cpp \
+    $$PWD/uploader.cpp \
+    $$PWD/util/formattedstring.cpp \
+    $$PWD/util/messagelistfilter.cpp \
+    $$PWD/util/nicklistfilter.cpp \
+    $$PWD/weechat.cpp \
+    $$PWD/parsepipeline.cpp \
+    $$PWD/windowhelper.cpp \
+    $$PWD/util/capture.cpp \
+    $$PWD/util/colortheme.cpp \
+    $$PWD/util/decompressor.cpp \
+    $$PWD/util/sockethelper.cpp \
+    $$PWD/util/tags.cpp
+
+INCLUDEPATH += \
+    $$PWD
+
+# relay messages are inflated in pieces while they're being received, that needs zlib itself
+qtConfig(system-zlib) {
+    LIBS += -lz
+}
+else {
+    QT += zlib-private
+}
+
+# zstd compressed relay messages (WeeChat 3.5 and newer) are supported if libzstd is available
+packagesExist(libzstd) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd
+    DEFINES += LITH_HAS_ZSTD
+}
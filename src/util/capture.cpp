@@ -0,0 +1,84 @@
+// Lith
+// Copyright (C) 2020 Martin Bříza
+// Copyright (C) 2020 Jakub Mach
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; If not, see <http://www.gnu.org/licenses/>.
+
+#include "capture.h"
+
+#include <QDataStream>
+#include <QDebug>
+
+namespace Capture {
+
+static constexpr qsizetype c_magicLength = sizeof(c_magic) - 1;
+
+bool Writer::open(const QString &path) {
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCritical() << "Can't open" << path << "for recording:" << m_file.errorString();
+        return false;
+    }
+    m_file.write(c_magic, c_magicLength);
+    m_timer.start();
+    m_lastFlush = 0;
+    m_unflushed = 0;
+    return true;
+}
+
+void Writer::write(const QByteArray &message) {
+    if (!m_file.isOpen())
+        return;
+    QDataStream s(&m_file);
+    s.setVersion(QDataStream::Qt_6_0);
+    auto msecs = m_timer.elapsed();
+    s << msecs << message;
+    // the point is to be able to look into freezes and crashes, so not much can stay in the buffer,
+    // but flushing every message would be a stall of its own on a busy relay
+    if (++m_unflushed >= c_flushRecords || msecs - m_lastFlush >= c_flushInterval)
+        flush();
+}
+
+void Writer::flush() {
+    if (!m_file.isOpen() || m_unflushed == 0)
+        return;
+    m_file.flush();
+    m_lastFlush = m_timer.elapsed();
+    m_unflushed = 0;
+}
+
+bool Reader::open(const QString &path) {
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qCritical() << "Can't open" << path << "for replaying:" << m_file.errorString();
+        return false;
+    }
+    if (m_file.read(c_magicLength) != QByteArray(c_magic, c_magicLength)) {
+        qCritical() << path << "is not a Lith capture file";
+        m_file.close();
+        return false;
+    }
+    return true;
+}
+
+bool Reader::next(Record &record) {
+    if (!m_file.isOpen() || m_file.atEnd())
+        return false;
+    QDataStream s(&m_file);
+    s.setVersion(QDataStream::Qt_6_0);
+    s >> record.msecs >> record.data;
+    return s.status() == QDataStream::Ok;
+}
+
+}
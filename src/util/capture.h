@@ -0,0 +1,66 @@
+// Lith
+// Copyright (C) 2020 Martin Bříza
+// Copyright (C) 2020 Jakub Mach
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+
+// Relay traffic capture: every (decompressed) message together with the time it arrived,
+// in milliseconds since the recording started. The file starts with c_magic followed by
+// the records serialized with QDataStream as a qint64 and a QByteArray.
+namespace Capture {
+    inline constexpr char c_magic[] = "LITHCAP1";
+
+    class Writer {
+    public:
+        bool open(const QString &path);
+        bool isOpen() const { return m_file.isOpen(); }
+        // the file gets flushed at most every c_flushInterval, or every c_flushRecords records
+        void write(const QByteArray &message);
+        // for whatever came after the last flush when the traffic stops
+        void flush();
+
+    private:
+        static constexpr qint64 c_flushInterval { 1000 };
+        static constexpr int c_flushRecords { 256 };
+
+        QFile m_file;
+        QElapsedTimer m_timer;
+        qint64 m_lastFlush { 0 };
+        int m_unflushed { 0 };
+    };
+
+    class Reader {
+    public:
+        struct Record {
+            qint64 msecs { 0 };
+            QByteArray data;
+        };
+
+        bool open(const QString &path);
+        // returns false when there are no more (complete) records
+        bool next(Record &record);
+
+    private:
+        QFile m_file;
+    };
+}
+
+#endif // CAPTURE_H
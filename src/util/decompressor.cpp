@@ -0,0 +1,179 @@
+// Lith
+// Copyright (C) 2020 Martin Bříza
+// Copyright (C) 2020 Jakub Mach
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; If not, see <http://www.gnu.org/licenses/>.
+
+#include "decompressor.h"
+
+#include <QDebug>
+
+#if __has_include(<QtZlib/zlib.h>)
+#include <QtZlib/zlib.h>
+#else
+#include <zlib.h>
+#endif
+
+#ifdef LITH_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+// how much room the output gets for each round of decompression, whatever is left unused is cut off again
+static constexpr qsizetype c_chunkSize = 64 * 1024;
+
+struct Decompressor::Private {
+    ~Private() {
+        if (zlibInitialized)
+            inflateEnd(&zlib);
+#ifdef LITH_HAS_ZSTD
+        ZSTD_freeDCtx(zstd);
+#endif
+    }
+
+    bool decompressZlib(QByteArrayView input, QByteArray &output);
+#ifdef LITH_HAS_ZSTD
+    bool decompressZstd(QByteArrayView input, QByteArray &output);
+#endif
+
+    Compression compression { Compression::Off };
+    z_stream zlib {};
+    bool zlibInitialized { false };
+#ifdef LITH_HAS_ZSTD
+    ZSTD_DCtx *zstd { nullptr };
+#endif
+    // how much bigger the messages get after decompression, used to reserve space in the output
+    qint64 totalIn { 0 };
+    qint64 totalOut { 0 };
+};
+
+Decompressor::Decompressor()
+    : d(std::make_unique<Private>())
+{
+}
+
+Decompressor::~Decompressor() {
+}
+
+bool Decompressor::isSupported(Compression compression) {
+    switch (compression) {
+    case Compression::Off:
+    case Compression::Zlib:
+        return true;
+    case Compression::Zstd:
+#ifdef LITH_HAS_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+bool Decompressor::reset(Compression compression) {
+    d->compression = compression;
+    switch (compression) {
+    case Compression::Off:
+        return true;
+    case Compression::Zlib:
+        if (d->zlibInitialized) {
+            inflateReset(&d->zlib);
+        }
+        else {
+            d->zlib = {};
+            d->zlibInitialized = inflateInit(&d->zlib) == Z_OK;
+        }
+        return d->zlibInitialized;
+    case Compression::Zstd:
+#ifdef LITH_HAS_ZSTD
+        if (!d->zstd)
+            d->zstd = ZSTD_createDCtx();
+        else
+            ZSTD_DCtx_reset(d->zstd, ZSTD_reset_session_only);
+        return d->zstd;
+#else
+        break;
+#endif
+    }
+    qCritical() << "Unsupported compression of a message:" << static_cast<int>(compression);
+    return false;
+}
+
+bool Decompressor::decompress(QByteArrayView input, QByteArray &output) {
+    auto ratio = d->totalIn > 0 ? qBound<qint64>(1, d->totalOut / d->totalIn + 1, 16) : 4;
+    output.reserve(output.size() + input.size() * ratio);
+    auto previousSize = output.size();
+
+    bool ok = false;
+    switch (d->compression) {
+    case Compression::Off:
+        output.append(input);
+        ok = true;
+        break;
+    case Compression::Zlib:
+        ok = d->zlibInitialized && d->decompressZlib(input, output);
+        break;
+    case Compression::Zstd:
+#ifdef LITH_HAS_ZSTD
+        ok = d->zstd && d->decompressZstd(input, output);
+#endif
+        break;
+    }
+    d->totalIn += input.size();
+    d->totalOut += output.size() - previousSize;
+    return ok;
+}
+
+bool Decompressor::Private::decompressZlib(QByteArrayView input, QByteArray &output) {
+    // zlib doesn't modify the input, it's just not declared as const
+    zlib.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    zlib.avail_in = static_cast<uInt>(input.size());
+    // as long as the scratch buffer keeps getting filled up, there may be more waiting inside zlib
+    do {
+        auto used = output.size();
+        output.resize(used + c_chunkSize);
+        zlib.next_out = reinterpret_cast<Bytef*>(output.data() + used);
+        zlib.avail_out = static_cast<uInt>(c_chunkSize);
+        auto result = inflate(&zlib, Z_NO_FLUSH);
+        output.resize(output.size() - zlib.avail_out);
+        if (result == Z_STREAM_END)
+            break;
+        // Z_BUF_ERROR just means there was nothing more to do with what we got so far
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            qCritical() << "Failed to decompress a message:" << (zlib.msg ? zlib.msg : "unknown error");
+            return false;
+        }
+    } while (zlib.avail_out == 0);
+    return true;
+}
+
+#ifdef LITH_HAS_ZSTD
+bool Decompressor::Private::decompressZstd(QByteArrayView input, QByteArray &output) {
+    ZSTD_inBuffer in { input.data(), static_cast<size_t>(input.size()), 0 };
+    while (true) {
+        auto used = output.size();
+        output.resize(used + c_chunkSize);
+        ZSTD_outBuffer out { output.data() + used, static_cast<size_t>(c_chunkSize), 0 };
+        auto result = ZSTD_decompressStream(zstd, &out, &in);
+        output.resize(used + out.pos);
+        if (ZSTD_isError(result)) {
+            qCritical() << "Failed to decompress a message:" << ZSTD_getErrorName(result);
+            return false;
+        }
+        // a full output buffer means zstd may still have more to flush even with all of the input consumed
+        if (in.pos == in.size && out.pos < out.size)
+            break;
+    }
+    return true;
+}
+#endif
@@ -0,0 +1,52 @@
+// Lith
+// Copyright (C) 2020 Martin Bříza
+// Copyright (C) 2020 Jakub Mach
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DECOMPRESSOR_H
+#define DECOMPRESSOR_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+
+#include <memory>
+
+// Inflates compressed relay messages in pieces, as they're coming from the socket
+class Decompressor {
+public:
+    // the compression byte of the relay message header
+    enum class Compression : quint8 {
+        Off = 0,
+        Zlib = 1,
+        Zstd = 2
+    };
+
+    Decompressor();
+    ~Decompressor();
+
+    static bool isSupported(Compression compression);
+
+    // starts a new message, returns false if the compression isn't supported
+    bool reset(Compression compression);
+    // decompresses the next piece of the current message straight to the end of output
+    // pass the same buffer every time, emptied with resize(0), and it won't have to allocate again
+    bool decompress(QByteArrayView input, QByteArray &output);
+
+private:
+    struct Private;
+    std::unique_ptr<Private> d;
+};
+
+#endif // DECOMPRESSOR_H
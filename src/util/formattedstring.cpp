@@ -125,8 +125,46 @@ FormattedString::FormattedString(QString &&o)
     : m_parts({std::move(o)})
 {}
 
+FormattedString FormattedString::fromRaw(QByteArrayView data, bool canContainHtml) {
+    FormattedString result;
+    if (data.isEmpty())
+        return result;
+    result.m_lazy = QSharedPointer<Lazy>::create();
+    result.m_lazy->raw = QByteArray(data.data(), data.size());
+    result.m_lazy->canContainHtml = canContainHtml;
+    return result;
+}
+
+const QList<FormattedString::Part> &FormattedString::parts() const {
+    if (!m_lazy)
+        return m_parts;
+    // copies of the string can end up in different threads, only one of them gets to decode it
+    if (!m_lazy->decoded.loadAcquire()) {
+        QMutexLocker locker(&m_lazy->mutex);
+        if (!m_lazy->decoded.loadRelaxed()) {
+            m_lazy->parts = Protocol::convertColorsToHtml(m_lazy->raw, m_lazy->canContainHtml).m_parts;
+            m_lazy->raw.clear();
+            m_lazy->decoded.storeRelease(1);
+        }
+    }
+    return m_lazy->parts;
+}
+
+QList<FormattedString::Part> &FormattedString::mutableParts() {
+    if (m_lazy) {
+        m_parts = parts();
+        m_lazy.reset();
+    }
+    return m_parts;
+}
+
+bool FormattedString::isUndecoded() const {
+    return m_lazy && !m_lazy->decoded.loadAcquire();
+}
+
 FormattedString &FormattedString::operator=(const char *o) {
     m_parts = { QString(o) };
+    m_lazy.reset();
     return *this;
 }
 
@@ -139,7 +177,7 @@ bool FormattedString::operator!=(const QString &o) {
 }
 
 FormattedString &FormattedString::operator+=(const QString &s) {
-    lastPart().text += s;
+    mutableParts().last().text += s;
     return *this;
 }
 
@@ -149,24 +187,26 @@ const ColorTheme &FormattedString::getCurrentTheme() {
 
 void FormattedString::clear() {
     m_parts = {{}};
+    m_lazy.reset();
 }
 
 FormattedString::Part &FormattedString::addPart(const FormattedString::Part &p) {
-    m_parts.append(p);
-    return m_parts.last();
+    auto &parts = mutableParts();
+    parts.append(p);
+    return parts.last();
 }
 
 FormattedString::Part &FormattedString::firstPart() {
-    return m_parts.first();
+    return mutableParts().first();
 }
 
 const FormattedString::Part &FormattedString::firstPart() const {
-    return m_parts.first();
+    return parts().first();
 }
 
 QString FormattedString::toPlain() const {
     QString ret;
-    for (auto &i : m_parts) {
+    for (auto &i : parts()) {
         ret.append(i.text);
     }
     return ret;
@@ -174,7 +214,7 @@ QString FormattedString::toPlain() const {
 
 QString FormattedString::toHtml(const ColorTheme &theme) const {
     QString ret { "<html><body><span style='white-space: pre-wrap;'>" };
-    for (auto &i : m_parts) {
+    for (auto &i : parts()) {
         ret.append(i.toHtml(theme));
     }
     ret.append("</span></body></html>");
@@ -185,7 +225,7 @@ QString FormattedString::toTrimmedHtml(int n, const ColorTheme &theme) const {
     if (n < 0)
         return toHtml(theme);
     QString ret = "<html><body><span style='white-space: pre-wrap;'>";
-    for (auto &i : m_parts) {
+    for (auto &i : parts()) {
         QString word = i.text.left(n);
         Part tempPart = i;
         tempPart.text = word;
@@ -203,26 +243,27 @@ QString FormattedString::toTrimmedHtml(int n, const ColorTheme &theme) const {
 }
 
 bool FormattedString::containsHtml() const {
-    return m_parts.count() > 1 || m_parts.first().containsHtml();
+    return parts().count() > 1 || parts().first().containsHtml();
 }
 
 int FormattedString::count() const {
-    return m_parts.count();
+    return parts().count();
 }
 
 FormattedString::Part &FormattedString::lastPart() {
-    return m_parts.last();
+    return mutableParts().last();
 }
 
 const FormattedString::Part &FormattedString::lastPart() const {
-    return m_parts.last();
+    return parts().last();
 }
 
 const FormattedString::Part &FormattedString::at(int index) const {
-    return m_parts.at(index);
+    return parts().at(index);
 }
 
 void FormattedString::prune() {
+    mutableParts();
     auto it = m_parts.begin();
     while (it != m_parts.end()) {
         // Originally: QRegExp re(R"(((?:(?:https?|ftp|file):\/\/|www\.|ftp\.)(?:\([-A-Z0-9+&@#\/%=~_|$?!:,.]*\)|[-A-Z0-9+&@#\/%=~_|$?!:,.])*(?:\([-A-Z0-9+&@#\/%=~_|$?!:,.]*\)|[A-Z0-9+&@#\/%=~_|$])))", Qt::CaseInsensitive, QRegExp::W3CXmlSchema11);
@@ -287,8 +328,27 @@ int FormattedString::length() const {
     return toPlain().length();
 }
 
+static qsizetype partsMemoryUsage(const QList<FormattedString::Part> &parts) {
+    qsizetype result = parts.capacity() * sizeof(FormattedString::Part);
+    for (const auto &i : parts)
+        result += i.text.capacity() * sizeof(QChar);
+    return result;
+}
+
+qsizetype FormattedString::memoryUsage() const {
+    qsizetype result = sizeof(FormattedString) + partsMemoryUsage(m_parts);
+    if (m_lazy) {
+        result += sizeof(Lazy);
+        if (m_lazy->decoded.loadAcquire())
+            result += partsMemoryUsage(m_lazy->parts);
+        else
+            result += m_lazy->raw.capacity();
+    }
+    return result;
+}
+
 FormattedString &FormattedString::operator+=(const char *s) {
-    lastPart().text += s;
+    mutableParts().last().text += s;
     return *this;
 }
 
@@ -297,6 +357,11 @@ bool FormattedString::operator!=(const FormattedString &o) {
 }
 
 bool FormattedString::operator==(const FormattedString &o) {
+    if (m_lazy && m_lazy == o.m_lazy)
+        return true;
+    // same raw bytes decode to the same text, anything else has to be decoded to tell
+    if (m_lazy && o.m_lazy && m_lazy->canContainHtml == o.m_lazy->canContainHtml && m_lazy->raw == o.m_lazy->raw)
+        return true;
     return toPlain() == o.toPlain();
 }
 
@@ -306,11 +371,13 @@ FormattedString::operator QString() const {
 
 FormattedString &FormattedString::operator=(QString &&o) {
     m_parts = { std::move(o) };
+    m_lazy.reset();
     return *this;
 }
 
 FormattedString &FormattedString::operator=(const QString &o) {
     m_parts = { o };
+    m_lazy.reset();
     return *this;
 }
 
@@ -20,6 +20,10 @@
 #include <QObject>
 #include <QString>
 #include <QList>
+#include <QByteArrayView>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QAtomicInt>
 
 #include "colortheme.h"
 
@@ -51,6 +55,8 @@ public:
     FormattedString(const char *d);
     FormattedString(const QString &o);
     FormattedString(QString &&o);
+    // keeps the raw relay bytes, they get decoded into parts only when something asks for them
+    static FormattedString fromRaw(QByteArrayView data, bool canContainHtml);
 
     FormattedString &operator=(const QString &o);
     FormattedString &operator=(QString &&o);
@@ -94,8 +100,25 @@ public:
     std::string toStdString() const;
     int length() const;
 
+    // rough number of bytes held, shared data counts fully for every copy
+    qsizetype memoryUsage() const;
+
 private:
+    // shared by all copies so the decoding happens (at most) once
+    struct Lazy {
+        QByteArray raw;
+        bool canContainHtml { false };
+        QMutex mutex;
+        QAtomicInt decoded { 0 };
+        QList<Part> parts;
+    };
+
+    const QList<Part> &parts() const;
+    QList<Part> &mutableParts();
+    bool isUndecoded() const;
+
     QList<Part> m_parts {};
+    QSharedPointer<Lazy> m_lazy;
 };
 
 Q_DECLARE_METATYPE(FormattedString)
@@ -32,15 +32,9 @@ bool MessageFilterList::filterAcceptsRow(int source_row, const QModelIndex &sour
     if (!sourceModel())
         return true;
 
-    auto index = sourceModel()->index(source_row, 0, source_parent);
-    auto v = sourceModel()->data(index);
-    auto b = qvariant_cast<BufferLine*>(v);
-
-    if (b && !Lith::instance()->settingsGet()->showJoinPartQuitMessagesGet()) {
-        return !b->isJoinPartQuitMsgGet();
+    if (!Lith::instance()->settingsGet()->showJoinPartQuitMessagesGet()) {
+        auto index = sourceModel()->index(source_row, 0, source_parent);
+        return !sourceModel()->data(index, LineModel::IsJoinPartQuitMsgRole).toBool();
     }
-    else
-        return b;
-
-    return false;
+    return true;
 }
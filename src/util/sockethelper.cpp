@@ -2,7 +2,7 @@
 #include "weechat.h"
 #include "lith.h"
 
-#include <QDataStream>
+#include <QtEndian>
 
 SocketHelper::SocketHelper(Weechat *parent)
     : QObject(parent)
@@ -25,6 +25,14 @@ Weechat *SocketHelper::weechat()
     return qobject_cast<Weechat*>(parent());
 }
 
+int SocketHelper::queueDepth() const {
+    return m_queueDepth;
+}
+
+qint64 SocketHelper::bytesInFlight() const {
+    return m_bytesInFlight;
+}
+
 void SocketHelper::onError(QAbstractSocket::SocketError e) {
     qWarning() << "Error!" << e;
 #ifndef __EMSCRIPTEN__
@@ -56,6 +64,7 @@ void SocketHelper::connectToWebsocket(const QString &hostname, const QString &en
     connect(m_webSocket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error), this, &SocketHelper::onError);
 
     connect(m_webSocket, &QWebSocket::binaryMessageReceived, this, &SocketHelper::onBinaryMessageReceived);
+    connect(m_webSocket, &QWebSocket::bytesWritten, this, &SocketHelper::onBytesWritten);
 
     QList<QSslError> expectedSslErrors;
     if (weechat()->lith()->settingsGet()->allowSelfSignedCertificatesGet()) {
@@ -93,6 +102,7 @@ void SocketHelper::connectToTcpSocket(const QString &hostname, int port, bool en
     connect(m_tcpSocket, &QSslSocket::readyRead, this, &SocketHelper::onReadyRead, Qt::QueuedConnection);
     connect(m_tcpSocket, &QSslSocket::connected, this, &SocketHelper::onConnected, Qt::QueuedConnection);
     connect(m_tcpSocket, &QSslSocket::disconnected, this, &SocketHelper::onDisconnected, Qt::QueuedConnection);
+    connect(m_tcpSocket, &QSslSocket::bytesWritten, this, &SocketHelper::onBytesWritten);
 
     if (encrypted)
         m_tcpSocket->connectToHostEncrypted(hostname, port);
@@ -111,22 +121,53 @@ qint64 SocketHelper::write(const QString &data) {
 }
 
 qint64 SocketHelper::write(const QByteArray &data) {
+    if (!isConnected())
+        return 0;
+    if (m_outgoing.isEmpty())
+        QMetaObject::invokeMethod(this, &SocketHelper::flush, Qt::QueuedConnection);
+    m_outgoing.append(data);
+    m_queueDepth++;
+    return data.size();
+}
+
+void SocketHelper::flush() {
+    if (m_outgoing.isEmpty())
+        return;
     qint64 bytes = 0;
+    // the relay splits what it receives by lines, so several commands can share a single write or frame
     if (m_webSocket) {
-        bytes = m_webSocket->sendTextMessage(data);
+        bytes = m_webSocket->sendTextMessage(QString::fromUtf8(m_outgoing));
     }
 #ifndef __EMSCRIPTEN__
     if (m_tcpSocket) {
-        bytes = m_tcpSocket->write(data);
+        bytes = m_tcpSocket->write(m_outgoing);
     }
 #endif // __EMSCRIPTEN__
-    if (bytes != data.count()) {
-        qWarning() << "fetchLines: Attempted to write" << data.count() << "but managed to write" << bytes;
+    bool success = bytes == m_outgoing.size();
+    if (!success) {
+        qWarning() << "flush: Attempted to write" << m_outgoing.size() << "bytes of" << m_queueDepth << "commands but managed to write" << bytes;
     }
-    return bytes;
+    if (bytes > 0)
+        m_bytesInFlight += bytes;
+    m_outgoing.clear();
+    m_queueDepth = 0;
+    emit flushed(success);
+    if (!success)
+        emit errorOccurred("Failed to send data to the relay");
+}
+
+void SocketHelper::onBytesWritten(qint64 bytes) {
+    m_bytesInFlight = qMax<qint64>(0, m_bytesInFlight - bytes);
 }
 
 void SocketHelper::reset() {
+    bool dropped = !m_outgoing.isEmpty();
+    m_outgoing.clear();
+    m_queueDepth = 0;
+    m_bytesInFlight = 0;
+    // whoever waits for the queued commands has to know they're not coming
+    if (dropped)
+        emit flushed(false);
     if (m_webSocket) {
         m_webSocket->deleteLater();
         m_webSocket = nullptr;
@@ -136,38 +177,35 @@ void SocketHelper::reset() {
         m_tcpSocket->deleteLater();
         m_tcpSocket = nullptr;
     }
+    m_receiveBuffer.clear();
+    m_bytesRemaining = 0;
+    m_compression = Decompressor::Compression::Off;
+    m_streaming = false;
 #endif // __EMSCRIPTEN__
 }
 
 void SocketHelper::onBinaryMessageReceived(const QByteArray &data) {
     if (data.size() > 5) {
-        auto header = data.left(5);
-        if (header.size() != 5) {
-            return;
-        }
-        qint32 bytes;
-        bool compressed;
-        QDataStream s(&header, QIODevice::ReadOnly);
-        s >> bytes >> compressed;
+        qint32 bytes = qFromBigEndian<qint32>(data.constData());
+        auto compression = static_cast<Decompressor::Compression>(data[4]);
         if (bytes <= 5) {
             qCritical() << "The server sent a message header saying the message is shorter than 5 bytes, that doesn't make sense";
             m_webSocket->close();
             reset();
             return;
         }
-        QByteArray dataCopy;
-        if (compressed) {
-            dataCopy = data.mid(1);
-            dataCopy[0] = 0;
-            dataCopy[1] = 0;
-            dataCopy[2] = 0;
-            dataCopy[3] = 0;
-            dataCopy = qUncompress(dataCopy);
+        auto message = QByteArrayView(data).mid(5);
+        // keeps its allocation unless the previous message is still being held by someone
+        m_decompressed.resize(0);
+        if (compression == Decompressor::Compression::Off) {
+            m_decompressed.append(message);
         }
-        else {
-            dataCopy = data.mid(5);
+        else if (!m_decompressor.reset(compression) || !m_decompressor.decompress(message, m_decompressed)) {
+            m_webSocket->close();
+            reset();
+            return;
         }
-        emit dataReceived(dataCopy);
+        emit dataReceived(m_decompressed);
     }
 }
 
@@ -186,57 +224,73 @@ void SocketHelper::onReadyRead() {
         return;
     }
 
-    // In the protocol parser, there's the call to processEvents that could lead to
-    // this slot being called while a message is already being processed
-    // This is guard that prevents processing of more messages at the same moment
-    static bool guard = false;
-    if (guard)
+    // take everything that's available in one go, the buffer keeps its allocation between wakeups
+    auto available = m_tcpSocket->bytesAvailable();
+    if (available <= 0)
         return;
+    auto used = m_receiveBuffer.size();
+    m_receiveBuffer.resize(used + available);
+    auto bytesRead = m_tcpSocket->read(m_receiveBuffer.data() + used, available);
+    m_receiveBuffer.resize(used + qMax<qint64>(0, bytesRead));
+
+    // then slice out as many messages as there are in there
+    const char *data = m_receiveBuffer.constData();
+    const qsizetype size = m_receiveBuffer.size();
+    qsizetype offset = 0;
+    while (offset < size) {
+        // not waiting for the rest of any message, get a new header
+        if (m_bytesRemaining == 0) {
+            if (size - offset < 5)
+                break;
+            m_bytesRemaining = qFromBigEndian<qint32>(data + offset);
+            m_compression = static_cast<Decompressor::Compression>(data[offset + 4]);
+            offset += 5;
+            if (m_bytesRemaining <= 5) {
+                qCritical() << "The server sent a message header saying the message is shorter than 5 bytes, that doesn't make sense";
+                m_receiveBuffer.clear();
+                m_bytesRemaining = 0;
+                m_tcpSocket->disconnectFromHost();
+                return;
+            }
+            m_bytesRemaining -= 5;
+            m_streaming = m_bytesRemaining > c_streamingThreshold;
+            if (!m_decompressor.reset(m_compression)) {
+                m_receiveBuffer.clear();
+                m_bytesRemaining = 0;
+                m_tcpSocket->disconnectFromHost();
+                return;
+            }
+        }
 
-    static bool compressed = false;
-
-    // not waiting for the rest of any message, get a new header
-    if (m_bytesRemaining == 0) {
-        auto header = m_tcpSocket->read(5);
-        if (header.size() != 5) {
-            return;
+        QByteArrayView message(data + offset, qMin<qsizetype>(m_bytesRemaining, size - offset));
+        if (!m_streaming && message.size() < m_bytesRemaining) {
+            // the rest of the message is still on its way
+            break;
         }
-        QDataStream s(&header, QIODevice::ReadOnly);
-        s >> m_bytesRemaining >> compressed;
-        if (m_bytesRemaining <= 5) {
-            qCritical() << "The server sent a message header saying the message is shorter than 5 bytes, that doesn't make sense";
+        // big messages are passed on in pieces right away so the parser can start working on them
+        // everything else only once it's complete
+        // keeps its allocation unless the previous message is still being held by someone
+        m_decompressed.resize(0);
+        if (m_compression == Decompressor::Compression::Off) {
+            m_decompressed.append(message);
+        }
+        else if (!m_decompressor.decompress(message, m_decompressed)) {
+            m_receiveBuffer.clear();
+            m_bytesRemaining = 0;
             m_tcpSocket->disconnectFromHost();
             return;
         }
-        m_bytesRemaining -= 5;
-        m_fetchBuffer.clear();
-        // add a header to the data if compressed, containing the expected length of the data
-        // Qt doesn't seem to care if it's correct so just put 0 in there
-        if (compressed)
-            m_fetchBuffer.append(4, 0);
+        offset += message.size();
+        m_bytesRemaining -= message.size();
+        if (m_streaming)
+            emit dataChunkReceived(m_decompressed, m_bytesRemaining == 0);
+        else
+            emit dataReceived(m_decompressed);
     }
 
-    // continue in whatever message came before (be it from a previous readyRead or this one
-    if (m_bytesRemaining > 0) {
-        auto cache = m_tcpSocket->read(m_bytesRemaining);
-        m_bytesRemaining -= cache.count();
-        m_fetchBuffer.append(cache);
-    }
-
-    // one message has been received in full, process it
-    if (m_bytesRemaining == 0) {
-        if (compressed) {
-            m_fetchBuffer = qUncompress(m_fetchBuffer);
-        }
-        guard = true;
-        emit dataReceived(m_fetchBuffer);
-        guard = false;
-        m_fetchBuffer.clear();
-    }
-
-    // if there's still more data left, do one more round
-    if (m_tcpSocket && m_tcpSocket->bytesAvailable()) {
-        onReadyRead();
-    }
+    // only the beginning of an incomplete message stays, moved to the front
+    m_receiveBuffer.remove(0, offset);
+    if (m_receiveBuffer.isEmpty() && m_receiveBuffer.capacity() > c_receiveBufferRetained)
+        m_receiveBuffer.squeeze();
 }
 #endif // __EMSCRIPTEN__
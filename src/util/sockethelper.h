@@ -10,6 +10,8 @@
 #endif // __EMSCRIPTEN__
 #include <QSslError>
 
+#include "decompressor.h"
+
 class Weechat;
 
 class SocketHelper : public QObject {
@@ -21,6 +23,11 @@ public:
 
     Weechat *weechat();
 
+    // commands waiting for the end of the current event loop iteration
+    int queueDepth() const;
+    // sent to the socket but not written out by it yet
+    qint64 bytesInFlight() const;
+
 public slots:
     void reset();
 
@@ -31,13 +38,20 @@ public slots:
 
     qint64 write(const char *data);
     qint64 write(const QString &data);
+    // queues the data, everything written during one event loop iteration is sent together
+    // returns how much was queued (0 when not connected), whether it got sent is reported with flushed
     qint64 write(const QByteArray &data);
+    void flush();
 
 signals:
     void connected();
     void disconnected();
     void dataReceived(const QByteArray &data);
+    // parts of a big message, decompressed, handed out as they arrive
+    void dataChunkReceived(const QByteArray &data, bool finished);
     void errorOccurred(const QString &message);
+    // everything queued since the previous one was written to the socket, or it couldn't be
+    void flushed(bool success);
 
 private slots:
     void onError(QAbstractSocket::SocketError e);
@@ -50,15 +64,30 @@ private slots:
 #endif // __EMSCRIPTEN__
 
     void onBinaryMessageReceived(const QByteArray &data);
+    void onBytesWritten(qint64 bytes);
 private:
     QTimer *m_timeoutTimer { new QTimer(this) };
 
+    QByteArray m_outgoing;
+    int m_queueDepth { 0 };
+    qint64 m_bytesInFlight { 0 };
+
     QWebSocket *m_webSocket { nullptr };
 #ifndef __EMSCRIPTEN__
     QSslSocket *m_tcpSocket { nullptr };
-    QByteArray m_fetchBuffer;
+    // everything read from the socket that doesn't make a complete message yet
+    QByteArray m_receiveBuffer;
+    // after a burst of big messages, don't hold onto more than this while idle
+    static constexpr qsizetype c_receiveBufferRetained { 1024 * 1024 };
     qint32 m_bytesRemaining { 0 };
+    Decompressor::Compression m_compression { Decompressor::Compression::Off };
+    // messages bigger than this are passed on in chunks while they're still being received
+    static constexpr qint32 c_streamingThreshold { 64 * 1024 };
+    bool m_streaming { false };
 #endif // __EMSCRIPTEN__
+    Decompressor m_decompressor;
+    // the message being handed out, reused for the next one
+    QByteArray m_decompressed;
 };
 
 #endif // SOCKETHELPER_H
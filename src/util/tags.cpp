@@ -0,0 +1,115 @@
+// Lith
+// Copyright (C) 2020 Martin Bříza
+// Copyright (C) 2020 Jakub Mach
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; If not, see <http://www.gnu.org/licenses/>.
+
+#include "tags.h"
+
+#include <QHash>
+#include <QReadWriteLock>
+
+namespace Tags {
+
+namespace {
+// there's one of these per nick, host or message, they're kept with the line
+const char *const c_uninterned[] = { "nick_", "host_", "prefix_nick_", "irc_tag_" };
+// in case scripts come up with other kinds of tags like that, the table won't grow past this
+constexpr int c_maxAtoms = 1024;
+constexpr Atom c_otherBit = Atom(1) << 31;
+
+struct Table {
+    Table() {
+        // has to be in the same order as the Known enum
+        for (const char *i : { "irc_privmsg", "irc_join", "irc_part", "irc_quit", "irc_action", "irc_notice", "self_msg",
+                               "notify_none", "notify_low", "notify_message", "notify_private", "notify_highlight" }) {
+            atoms.insert(i, names.count());
+            names.append(i);
+        }
+        Q_ASSERT(names.count() == _KnownCount);
+    }
+
+    QReadWriteLock lock;
+    QHash<QByteArray, Atom> atoms;
+    QStringList names;
+};
+
+Table &table() {
+    static Table table;
+    return table;
+}
+
+// c_otherBit when the tag doesn't get interned
+Atom intern(QByteArrayView tag) {
+    for (auto i : c_uninterned) {
+        if (tag.startsWith(i))
+            return c_otherBit;
+    }
+    auto &t = table();
+    // just for the lookup, it doesn't copy the tag
+    auto key = QByteArray::fromRawData(tag.data(), tag.size());
+    {
+        QReadLocker locker(&t.lock);
+        auto it = t.atoms.constFind(key);
+        if (it != t.atoms.constEnd())
+            return *it;
+    }
+    QWriteLocker locker(&t.lock);
+    // someone could have added it in the meantime
+    auto it = t.atoms.constFind(key);
+    if (it != t.atoms.constEnd())
+        return *it;
+    if (t.names.count() >= c_maxAtoms)
+        return c_otherBit;
+    Atom atom = t.names.count();
+    t.atoms.insert(tag.toByteArray(), atom);
+    t.names.append(QString::fromUtf8(tag));
+    return atom;
+}
+}
+
+void Set::add(QByteArrayView tag) {
+    auto atom = intern(tag);
+    if (atom == c_otherBit) {
+        atoms.append(c_otherBit | Atom(other.count()));
+        other.append(tag.toByteArray());
+        return;
+    }
+    if (atom < _KnownCount)
+        mask |= bit(Known(atom));
+    atoms.append(atom);
+}
+
+QStringList Set::names() const {
+    auto &t = table();
+    QReadLocker locker(&t.lock);
+    QStringList result;
+    result.reserve(atoms.count());
+    for (auto i : atoms) {
+        if (i & c_otherBit)
+            result.append(QString::fromUtf8(other.value(i & ~c_otherBit)));
+        else
+            result.append(t.names.value(i));
+    }
+    return result;
+}
+
+qsizetype Set::memoryUsage() const {
+    qsizetype result = atoms.capacity() * sizeof(Atom) + other.capacity() * sizeof(QByteArray);
+    for (const auto &i : other)
+        result += i.capacity();
+    return result;
+}
+
+}
@@ -0,0 +1,69 @@
+// Lith
+// Copyright (C) 2020 Martin Bříza
+// Copyright (C) 2020 Jakub Mach
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TAGS_H
+#define TAGS_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+
+// Line tags that repeat a lot are interned into a global table, every distinct one is stored just once and lines
+// only keep their atoms. Tags carrying a nick, a host or some per-message value stay with the line as they came,
+// interning them would only make the table grow for as long as Lith runs.
+// The tags Lith looks at are registered first so their atoms double as bit positions in a line's mask.
+namespace Tags {
+    using Atom = quint32;
+    using Mask = quint32;
+
+    enum Known : Atom {
+        IrcPrivmsg,
+        IrcJoin,
+        IrcPart,
+        IrcQuit,
+        IrcAction,
+        IrcNotice,
+        SelfMsg,
+        NotifyNone,
+        NotifyLow,
+        NotifyMessage,
+        NotifyPrivate,
+        NotifyHighlight,
+        _KnownCount
+    };
+    static_assert(_KnownCount <= sizeof(Mask) * 8, "Known tags have to fit into the mask");
+
+    constexpr Mask bit(Known tag) { return Mask(1) << tag; }
+
+    // the tags of a single line, in the order they came in
+    struct Set {
+        // takes the UTF-8 bytes of a tag right from the relay message
+        void add(QByteArrayView tag);
+        bool has(Known tag) const { return mask & bit(tag); }
+        QStringList names() const;
+        qsizetype memoryUsage() const;
+
+        // atoms with the top bit set point to other instead of the table
+        QList<Atom> atoms;
+        QList<QByteArray> other;
+        Mask mask { 0 };
+    };
+}
+
+#endif // TAGS_H
@@ -25,6 +25,12 @@
 #include <QPasswordDigestor>
 #include <QCryptographicHash>
 #include <QRandomGenerator>
+#include <QLoggingCategory>
+
+#include <utility>
+
+// turned on with QT_LOGGING_RULES="lith.stats.debug=true"
+Q_LOGGING_CATEGORY(statsLog, "lith.stats", QtInfoMsg)
 
 Weechat::Weechat(Lith *lith)
     : QObject(nullptr)
@@ -32,9 +38,11 @@ Weechat::Weechat(Lith *lith)
     , m_lith(lith)
 {
     connect(m_connection, &SocketHelper::dataReceived, this, &Weechat::onDataReceived, Qt::QueuedConnection);
+    connect(m_connection, &SocketHelper::dataChunkReceived, this, &Weechat::onDataChunkReceived, Qt::QueuedConnection);
     connect(m_connection, &SocketHelper::connected, this, &Weechat::onConnected, Qt::QueuedConnection);
     connect(m_connection, &SocketHelper::disconnected, this, &Weechat::onDisconnected, Qt::QueuedConnection);
     connect(m_connection, &SocketHelper::errorOccurred, this, &Weechat::onError, Qt::QueuedConnection);
+    connect(m_connection, &SocketHelper::flushed, this, &Weechat::onFlushed);
 
     connect(lith, &Lith::pongReceived, this, &Weechat::onPongReceived, Qt::QueuedConnection);
     connect(m_pingTimer, &QTimer::timeout, this, &Weechat::onPingTimeout, Qt::QueuedConnection);
@@ -44,6 +52,10 @@ Weechat::Weechat(Lith *lith)
     connect(m_reconnectTimer, &QTimer::timeout, this, &Weechat::restart, Qt::QueuedConnection);
     m_reconnectTimer->setInterval(100);
     m_reconnectTimer->setSingleShot(false);
+
+    m_pipeline.setSink([this](QList<ParsePipeline::Message> &&messages) {
+        deliverMessages(std::move(messages));
+    });
 }
 
 Lith *Weechat::lith() {
@@ -98,7 +110,8 @@ void Weechat::init() {
     //connect(m_timeoutTimer, &QTimer::timeout, this, &Weechat::onTimeout, Qt::QueuedConnection);
 
     connect(m_hotlistTimer, &QTimer::timeout, this, &Weechat::requestHotlist, Qt::QueuedConnection);
-    m_hotlistTimer->setInterval(10000);
+    // counts are kept locally from new lines, asking the relay just in case something got missed
+    m_hotlistTimer->setInterval(5 * 60 * 1000);
     m_hotlistTimer->setSingleShot(false);
 
     connect(lith()->settingsGet(), &Settings::ready, this, &Weechat::onConnectionSettingsChanged, Qt::QueuedConnection);
@@ -111,6 +124,8 @@ void Weechat::init() {
 }
 
 void Weechat::start() {
+    if (m_replaying)
+        return;
     m_connection->reset();
     m_restarting = false;
     qCritical() << "Connecting";
@@ -121,6 +136,9 @@ void Weechat::start() {
 }
 
 void Weechat::restart() {
+    // the session comes from the capture, real traffic mustn't get mixed in
+    if (m_replaying)
+        return;
     m_initializationStatus = UNINITIALIZED;
     auto host = lith()->settingsGet()->hostGet();
     auto port = lith()->settingsGet()->portGet();
@@ -136,11 +154,15 @@ void Weechat::restart() {
 }
 
 void Weechat::onConnectionSettingsChanged() {
+    if (m_replaying)
+        return;
     auto host = lith()->settingsGet()->hostGet();
     auto pass = lith()->settingsGet()->passphraseGet();
     if (!host.isEmpty() && !pass.isEmpty()) {
         qCritical() << "CONNECTING";
         m_connection->reset();
+        // could be a different relay, nothing from the old one can be kept
+        QTimer::singleShot(0, lith(), &Lith::resetData);
         if (!m_restarting)
             QTimer::singleShot(50, this, &Weechat::start);
         m_restarting = true;
@@ -161,8 +183,12 @@ void Weechat::onHandshakeAccepted(const StringMap &data) {
     auto hash = hashPassword(pass, algo, salt, iterations);
 
     QString hashString;
-    if (algo == "plain")
-        hashString = "password=" + pass + ",compression=" + (lith()->settingsGet()->connectionCompressionGet() ? "zlib" : "off");
+    if (algo == "plain") {
+        hashString = "password=" + pass;
+        // the handshake already negotiated compression, older relays without it only know zlib
+        if (!data.contains("compression"))
+            hashString += QString(",compression=") + (lith()->settingsGet()->connectionCompressionGet() ? "zlib" : "off");
+    }
     else if (algo.startsWith("pbkdf2"))
         hashString = "password_hash=" + algo + ':' + salt.toHex() + ':' + QString("%1").arg(iterations) + ':' + hash.toHex();
     else
@@ -170,29 +196,38 @@ void Weechat::onHandshakeAccepted(const StringMap &data) {
 
     m_initializationStatus = (Initialization) (m_initializationStatus | HANDSHAKE);
 
-    m_connection->write(("init " + hashString + "\n").toUtf8());
-    m_connection->write(QString("(%1) hdata buffer:gui_buffers(*) number,name,short_name,hidden,title,local_variables\n").arg(MessageNames::c_requestBuffers).toUtf8());
-    m_connection->write(QString("(%1) hdata buffer:gui_buffers(*)/lines/last_line(-1)/data\n").arg(MessageNames::c_requestFirstLine).toUtf8());
-    m_connection->write(QString("(%1) hdata hotlist:gui_hotlist(*)\n").arg(MessageNames::c_requestHotlist).toUtf8());
+    // these all get sent in a single write
+    m_connection->write("init " + hashString.toUtf8() + "\n");
+    m_connection->write("(" + MessageNames::c_requestBuffers.toLatin1() + ") hdata buffer:gui_buffers(*) number,name,short_name,hidden,title,local_variables\n");
+    m_connection->write("(" + MessageNames::c_requestFirstLine.toLatin1() + ") hdata buffer:gui_buffers(*)/lines/last_line(-1)/data\n");
+    m_connection->write("(" + MessageNames::c_requestHotlist.toLatin1() + ") hdata hotlist:gui_hotlist(*)\n");
     m_connection->write("sync\n");
-    m_connection->write(QString("(%1) nicklist\n").arg(MessageNames::c_requestNicklist).toUtf8());
+    m_connection->write("(" + MessageNames::c_requestNicklist.toLatin1() + ") nicklist\n");
 }
 
 void Weechat::requestHotlist() {
     if (m_connection->isConnected()) {
-        auto msg = QString("(handleHotlist;%1) hdata hotlist:gui_hotlist(*)\n").arg(m_messageOrder++);
-        m_connection->write(msg.toUtf8());
+        m_connection->write("(handleHotlist;" + QByteArray::number(m_messageOrder++) + ") hdata hotlist:gui_hotlist(*)\n");
     }
 }
 
 
+// in the order of preference, the relay picks the first one it supports
+QString Weechat::compressionAlgos() {
+    if (!lith()->settingsGet()->connectionCompressionGet())
+        return "off";
+    if (lith()->settingsGet()->connectionCompressionCodecGet() == "zstd" && Decompressor::isSupported(Decompressor::Compression::Zstd))
+        return "zstd:zlib:off";
+    return "zlib:off";
+}
+
 void Weechat::onConnected() {
     qCritical() << "Connected!";
 
     m_reconnectTimer->stop();
     m_reconnectTimer->setInterval(100);
 
-    QTimer::singleShot(0, lith(), &Lith::resetData);
+    QTimer::singleShot(0, lith(), &Lith::resumeData);
     lith()->networkErrorStringSet(QString());
 
     lith()->statusSet(Lith::CONNECTED);
@@ -204,7 +239,7 @@ void Weechat::onConnected() {
     }
 
     if (lith()->settingsGet()->handshakeAuthGet()) {
-        m_connection->write(QString("(%1) handshake password_hash_algo=%2,compression=%3\n").arg(MessageNames::c_handshake).arg(hashAlgos).arg(lith()->settingsGet()->connectionCompressionGet() ? "zlib" : "off").toUtf8());
+        m_connection->write(QString("(%1) handshake password_hash_algo=%2,compression=%3\n").arg(MessageNames::c_handshake).arg(hashAlgos).arg(compressionAlgos()).toUtf8());
     }
     else {
         StringMap data;
@@ -220,6 +255,13 @@ void Weechat::onDisconnected() {
 
     m_fetchBuffer.clear();
     m_bytesRemaining = 0;
+    m_streamParser.reset();
+    m_pipeline.clear();
+    auto stats = m_pipeline.stats();
+    qCDebug(statsLog) << "Parse pipeline:" << stats.delivered << "of" << stats.submitted << "messages delivered, at most" << stats.maxInFlight << "in flight,"
+             << stats.stalls << "stalls taking" << stats.stalledMsecs << "ms";
+    qCDebug(statsLog) << "Outgoing:" << m_connection->queueDepth() << "commands still queued," << m_connection->bytesInFlight() << "bytes not written out by the socket";
+    m_recordBuffer.clear();
     m_hotlistTimer->stop();
 
     m_reconnectTimer->setInterval(m_reconnectTimer->interval() * 2);
@@ -227,77 +269,180 @@ void Weechat::onDisconnected() {
 }
 
 void Weechat::onDataReceived(const QByteArray &data) {
+    if (m_recorder.isOpen())
+        m_recorder.write(data);
     auto dataCopy(data);
     onMessageReceived(dataCopy);
 }
 
+void Weechat::onDataChunkReceived(const QByteArray &data, bool finished) {
+    if (m_recorder.isOpen()) {
+        m_recordBuffer.append(data);
+        if (finished) {
+            m_recorder.write(m_recordBuffer);
+            m_recordBuffer.clear();
+        }
+    }
+    m_streamParser.append(data);
+    if (m_streamParser.headerReady() && m_streamParser.isHData() && c_streamableMessages.contains(m_streamParser.id().split(";").first())) {
+        auto batchSize = qMax(1, lith()->settingsGet()->streamingBatchSizeGet());
+        while (true) {
+            m_streamParser.parseRows(batchSize);
+            auto pending = m_streamParser.pendingRows();
+            if (pending == 0 || (pending < batchSize && !m_streamParser.allRowsParsed()))
+                break;
+            dispatchHData(m_streamParser.id(), m_streamParser.takePending());
+        }
+        if (finished) {
+            if (!m_streamParser.allRowsParsed())
+                qCritical() << "Message" << m_streamParser.id() << "ended before all of its rows were received";
+            m_streamParser.reset();
+        }
+        return;
+    }
+    // not something that can be processed in parts, wait for the whole message
+    if (finished) {
+        auto message = m_streamParser.data();
+        m_streamParser.reset();
+        onMessageReceived(message);
+    }
+}
+
 void Weechat::onError(const QString &message) {
     lith()->statusSet(Lith::ERROR);
     lith()->networkErrorStringSet("Connection failed: "+ message);
 }
 
-bool Weechat::input(pointer_t ptr, const QString &data) {
+void Weechat::input(pointer_t ptr, const QStringList &lines, bool report) {
     // server doesn't reply to input commands directly so no message order here
-    auto line = QString("input 0x%1 %2\n").arg(ptr, 0, 16).arg(data);
-    //qCritical() << "WRITING:" << line;
-    auto message = line.toUtf8();
-    if (message.count() == m_connection->write(line.toUtf8()))
-        return true;
-    return false;
+    auto prefix = "input 0x" + QByteArray::number(ptr, 16) + ' ';
+    QByteArray message;
+    for (const auto &i : lines)
+        message += prefix + i.toUtf8() + '\n';
+    //qCritical() << "WRITING:" << message;
+    if (m_connection->write(message) <= 0) {
+        if (report)
+            emit inputSent(ptr, false);
+        return;
+    }
+    if (report)
+        m_pendingInputs.append(ptr);
+}
+
+void Weechat::onFlushed(bool success) {
+    // everything queued so far went out in this flush
+    auto pending = std::exchange(m_pendingInputs, {});
+    for (auto ptr : pending)
+        emit inputSent(ptr, success);
 }
 
 void Weechat::fetchLines(pointer_t ptr, int count) {
-    auto line = QString("(handleFetchLines;%1) hdata buffer:0x%2/lines/last_line(-%3)/data\n").arg(m_messageOrder++).arg(ptr, 0, 16).arg(count);
+    auto line = "(handleFetchLines;" + QByteArray::number(m_messageOrder++) + ") hdata buffer:0x" + QByteArray::number(ptr, 16) + "/lines/last_line(-" + QByteArray::number(count) + ")/data\n";
     //qCritical() << "WRITING:" << line;
-    m_connection->write(line.toUtf8());
+    m_connection->write(line);
     m_timeoutTimer->start(5000);
 }
 
-void Weechat::onMessageReceived(QByteArray &data) {
-    //qCritical() << "Message!" << data;
-    QDataStream s(&data, QIODevice::ReadOnly);
+void Weechat::fetchLinesBefore(pointer_t linePtr, int count) {
+    // the line itself is the first one in the reply
+    auto line = "(handleFetchLines;" + QByteArray::number(m_messageOrder++) + ") hdata line:0x" + QByteArray::number(linePtr, 16) + "(-" + QByteArray::number(count + 1) + ")/data\n";
+    m_connection->write(line);
+    m_timeoutTimer->start(5000);
+}
 
-    Protocol::String id = Protocol::parse<Protocol::String>(s);
+void Weechat::fetchNewLines(pointer_t ptr, int count) {
+    auto line = "(handleFetchNewLines;" + QByteArray::number(m_messageOrder++) + ") hdata buffer:0x" + QByteArray::number(ptr, 16) + "/lines/last_line(-" + QByteArray::number(count) + ")/data\n";
+    m_connection->write(line);
+}
 
-    char type[4] = { 0 };
-    s.readRawData(type, 3);
+void Weechat::record(const QString &path) {
+    if (m_recorder.open(path))
+        qCritical() << "Recording relay traffic to" << path;
+}
 
-    if (QString(type) == "hda") {
-        Protocol::HData hda = Protocol::parse<Protocol::HData>(s);
+void Weechat::replay(const QString &path, bool fast) {
+    if (!m_replay.open(path))
+        return;
+    qCritical() << "Replaying" << path << (fast ? "as fast as possible" : "at the original speed");
+    m_replaying = true;
+    m_replayFast = fast;
 
-        if (c_initializationMap.contains(id)) {
-            // wtf, why can't I write this as |= ?
-            m_initializationStatus = (Initialization) (m_initializationStatus | c_initializationMap.value(id, UNINITIALIZED));
-            if (!QMetaObject::invokeMethod(Lith::instance(), id.toStdString().c_str(), Qt::QueuedConnection, Q_ARG(Protocol::HData, hda))) {
-                qWarning() << "Possible unhandled message:" << id;
-            }
-        }
-        else {
-            auto name = id.split(";").first();
-            if (!QMetaObject::invokeMethod(Lith::instance(), name.toStdString().c_str(), Qt::QueuedConnection, Q_ARG(Protocol::HData, hda))) {
-                qWarning() << "Possible unhandled message:" << name;
-            }
-        }
-    }
-    else if (QString(type) == "htb") {
-        Protocol::HashTable htb = Protocol::parse<Protocol::HashTable>(s);
+    // everything comes from the capture, don't let anything connect to the relay in the meantime
+    m_connection->reset();
+    m_pingTimer->stop();
+    m_reconnectTimer->stop();
+    m_hotlistTimer->stop();
 
-        onHandshakeAccepted(htb);
-    }
-    else if (QString(type) == "str") {
-        Protocol::String str = Protocol::parse<Protocol::String>(s);
+    QTimer::singleShot(0, lith(), &Lith::resetData);
+    lith()->statusSet(Lith::CONNECTED);
 
-        if (!QMetaObject::invokeMethod(Lith::instance(), id.toStdString().c_str(), Qt::QueuedConnection, Q_ARG(const FormattedString&, str))) {
-            qWarning() << "Possible unhandled message:" << id;
-        }
+    m_replayTimer.start();
+    replayNext();
+}
+
+void Weechat::replayNext() {
+    if (!m_replayRecord.data.isEmpty())
+        onMessageReceived(m_replayRecord.data);
+    if (!m_replay.next(m_replayRecord)) {
+        qCritical() << "Replay finished after" << m_replayTimer.elapsed() << "ms";
+        return;
     }
-    else {
-        qCritical() << "onMessageReceived is not handling type: " << type;
+    qint64 delay = m_replayFast ? 0 : qMax<qint64>(0, m_replayRecord.msecs - m_replayTimer.elapsed());
+    QTimer::singleShot(delay, this, &Weechat::replayNext);
+}
+
+void Weechat::onMessageReceived(QByteArray &data) {
+    // only the id is needed right away, the rest gets parsed on the pipeline's threads
+    Protocol::Cursor s(data);
+    Protocol::String id = Protocol::parse<Protocol::String>(s);
+    markInitialized(id);
+
+    m_pipeline.submit(data);
+}
+
+void Weechat::dispatchHData(const QString &id, const Protocol::HData &hda) {
+    markInitialized(id);
+
+    // already parsed, goes through the pipeline anyway so it doesn't overtake the messages before it
+    ParsePipeline::Message message;
+    message.id = id;
+    message.type = ParsePipeline::Message::HData;
+    message.hdata = hda;
+    m_pipeline.submitParsed(std::move(message));
+}
+
+void Weechat::markInitialized(const QString &id) {
+    if (c_initializationMap.contains(id)) {
+        // wtf, why can't I write this as |= ?
+        m_initializationStatus = (Initialization) (m_initializationStatus | c_initializationMap.value(id, UNINITIALIZED));
     }
+}
 
-    if (!s.atEnd()) {
-        qCritical() << "STREAM WAS NOT AT END!!!";
+// called from the pipeline's threads, has to stay short
+void Weechat::deliverMessages(QList<ParsePipeline::Message> &&messages) {
+    for (const auto &i : messages) {
+        if (i.type == ParsePipeline::Message::HashTable) {
+            QMetaObject::invokeMethod(this, [this, htb = i.hashTable]() {
+                onHandshakeAccepted(htb);
+            }, Qt::QueuedConnection);
+        }
     }
+    // the whole batch goes to the GUI thread as a single event
+    QMetaObject::invokeMethod(lith(), [messages = std::move(messages)]() {
+        for (const auto &i : messages) {
+            if (i.type == ParsePipeline::Message::HData) {
+                auto name = c_initializationMap.contains(i.id) ? i.id : i.id.split(";").first();
+                if (!QMetaObject::invokeMethod(Lith::instance(), name.toStdString().c_str(), Qt::DirectConnection, Q_ARG(Protocol::HData, i.hdata))) {
+                    qWarning() << "Possible unhandled message:" << name;
+                }
+            }
+            else if (i.type == ParsePipeline::Message::String) {
+                if (!QMetaObject::invokeMethod(Lith::instance(), i.id.toStdString().c_str(), Qt::DirectConnection, Q_ARG(const FormattedString&, i.string))) {
+                    qWarning() << "Possible unhandled message:" << i.id;
+                }
+            }
+        }
+    }, Qt::QueuedConnection);
 }
 
 void Weechat::onPongReceived(qint64 id) {
@@ -312,14 +457,20 @@ void Weechat::onTimeout() {
 
 void Weechat::onPingTimeout() {
     static qint64 previousPing = 0;
+    // the recorder only flushes when it's writing, get the rest out once it's quiet
+    m_recorder.flush();
     if (m_initializationStatus == COMPLETE) {
         if (previousPing < m_lastReceivedPong - 1) {
             restart();
         }
         previousPing = m_messageOrder++;
-        if (m_connection->write(QString("(%1) ping %1\n").arg(previousPing)) <= 0) {
+        if (!m_connection->isConnected()) {
             restart();
+            return;
         }
+        // a write that fails later is reported through errorOccurred
+        auto order = QByteArray::number(previousPing);
+        m_connection->write("(" + order + ") ping " + order + "\n");
     }
     else {
         //restart();
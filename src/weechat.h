@@ -19,7 +19,10 @@
 
 #include "common.h"
 #include "settings.h"
+#include "protocol.h"
 #include "util/sockethelper.h"
+#include "util/capture.h"
+#include "parsepipeline.h"
 
 #include <QSslSocket>
 #include <QDataStream>
@@ -43,8 +46,21 @@ public slots:
     void start();
     void restart();
 
-    bool input(pointer_t ptr, const QString &data);
+    // sends all the lines in a single write, with report set inputSent is emitted once they're written to the socket or that fails
+    void input(pointer_t ptr, const QStringList &lines, bool report);
     void fetchLines(pointer_t ptr, int count);
+    // walks back from a line that's already there, only the lines older than it get sent
+    void fetchLinesBefore(pointer_t linePtr, int count);
+    // the newest lines of a buffer that was kept over a reconnect
+    void fetchNewLines(pointer_t ptr, int count);
+
+    // writes all received messages to a capture file
+    void record(const QString &path);
+    // feeds a capture file to the message handlers instead of connecting to the relay
+    void replay(const QString &path, bool fast);
+
+signals:
+    void inputSent(pointer_t ptr, bool success);
 
 private slots:
 
@@ -62,9 +78,18 @@ private slots:
     void onConnected();
     void onDisconnected();
     void onDataReceived(const QByteArray &data);
+    void onFlushed(bool success);
+    void onDataChunkReceived(const QByteArray &data, bool finished);
     void onError(const QString &message);
 
+    void replayNext();
+
 private:
+    QString compressionAlgos();
+    void dispatchHData(const QString &id, const Protocol::HData &hda);
+    void markInitialized(const QString &id);
+    void deliverMessages(QList<ParsePipeline::Message> &&messages);
+
     struct MessageNames {
         // these names actually correspond to slot names in Lith
         inline static const QString c_handshake { "handleHandshake" };
@@ -90,11 +115,29 @@ private:
         { MessageNames::c_requestNicklist, REQUEST_NICKLIST }
     };
 
+    // handlers that can take the rows of a single message in several calls
+    inline static const QStringList c_streamableMessages {
+        MessageNames::c_requestFirstLine,
+        "handleFetchLines"
+    };
+
     SocketHelper *m_connection;
+    // buffers with input waiting for the next flush of the connection
+    QList<pointer_t> m_pendingInputs;
     bool m_restarting { false };
 
     QByteArray m_fetchBuffer;
     qint32 m_bytesRemaining { 0 };
+    Protocol::StreamParser m_streamParser;
+    ParsePipeline m_pipeline;
+
+    Capture::Writer m_recorder;
+    QByteArray m_recordBuffer;
+    Capture::Reader m_replay;
+    Capture::Reader::Record m_replayRecord;
+    QElapsedTimer m_replayTimer;
+    bool m_replaying { false };
+    bool m_replayFast { false };
 
     QTimer *m_hotlistTimer { new QTimer(this) };
     QTimer *m_timeoutTimer { new QTimer(this) };
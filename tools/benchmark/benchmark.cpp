@@ -0,0 +1,443 @@
+#include "protocol.h"
+#include "datamodel.h"
+#include "qmlobjectlist.h"
+#include "lith.h"
+#include "util/capture.h"
+#include "parsepipeline.h"
+#include "relaywriter.h"
+
+#include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QtTest>
+#include <QSemaphore>
+
+#include <functional>
+
+// Synthetic payloads, roughly what a busy IRC buffer sends
+static const QByteArray plainMessage = "just a regular line of text without any formatting, like most messages on IRC are";
+static const QByteArray unicodeMessage = "příliš žluťoučký kůň úpěl ďábelské ódy 🐴 日本語のテキストも";
+static const QByteArray coloredPrefix = "\x19" "F@00214" "nickname" "\x19" "F09";
+static const QByteArray coloredMessage = "\x19" "F02" "green " "\x1A" "*" "bold" "\x1B" "*" " then " "\x19" "*@00123,@00045" "extended"
+                                         "\x1C" " and " "\x19" "B05" "background" "\x1C" " back to normal";
+static const QByteArray urlMessage = "have a look at https://github.com/LithApp/Lith/issues?q=is%3Aopen and www.example.com/path tomorrow";
+
+static const QByteArray lineKeys = "buffer:ptr,date:tim,date_printed:tim,displayed:chr,highlight:chr,tags_array:arr,prefix:str,message:str";
+static const QByteArray bufferKeys = "number:int,name:str,short_name:str,hidden:int,title:str,local_variables:htb";
+
+static void writeLines(RelayWriter &w, int count) {
+    const QByteArray messages[] = { plainMessage, unicodeMessage, coloredMessage, urlMessage };
+    w.hdata("buffer/lines/line/line_data", lineKeys, count);
+    for (int i = 0; i < count; i++) {
+        w.pointer(0x55d0c0de0000).pointer(0x55d0c0de1000).pointer(0x55d0c0de2000 + i * 0x40).pointer(0x55d0c0de3000 + i * 0x40);
+        w.pointer(0x55d0c0de0000)
+         .time(1600000000 + i)
+         .time(1600000000 + i)
+         .chr(1)
+         .chr(i % 17 == 0)
+         .arrayStr({ "irc_privmsg", "notify_message", "prefix_nick_248", "nick_somebody", "host_~user@example.com", "log1" })
+         .string(coloredPrefix)
+         .string(messages[i % 4]);
+    }
+}
+
+static void writeBuffers(RelayWriter &w, int count) {
+    w.hdata("buffer", bufferKeys, count);
+    for (int i = 0; i < count; i++) {
+        auto name = "irc.libera.#channel" + QByteArray::number(i);
+        w.pointer(0x55d0b0000000 + i * 0x100)
+         .integer(i + 1)
+         .string(name)
+         .string("#channel" + QByteArray::number(i))
+         .integer(0)
+         .string("Welcome to " + name + " | " + urlMessage)
+         .hashTable({ { "plugin", "irc" }, { "name", name }, { "type", "channel" }, { "nick", "somebody" }, { "server", "libera" } });
+    }
+}
+
+class Benchmark : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+
+    void parseChar();
+    void parseInteger();
+    void parseLongInteger();
+    void parseString();
+    void parseStringDecoded();
+    void parseBuffer();
+    void parsePointer();
+    void parseTime();
+    void parseHashTable();
+    void parseArrayInt();
+    void parseArrayStr();
+    void parseHData_data();
+    void parseHData();
+    void parsePipeline();
+
+    void convertColorsToHtml_data();
+    void convertColorsToHtml();
+    void prune();
+    void toHtml_data();
+    void toHtml();
+    void toTrimmedHtml_data();
+    void toTrimmedHtml();
+
+    void qmlObjectListPrepend();
+    void qmlObjectListPrependBatch();
+    void qmlObjectListAppend();
+    void lineModelPrepend();
+    void lineModelPrependBatch();
+    void lineModelAppend();
+
+    void recordedMessages_data();
+    void recordedMessages();
+
+private:
+    static QByteArray payload(const std::function<void(RelayWriter &)> &write);
+    static QByteArray hdataBody(const QByteArray &message);
+};
+
+QByteArray Benchmark::payload(const std::function<void(RelayWriter &)> &write) {
+    // the id is written by the constructor, drop it so the data starts with the value itself
+    RelayWriter w;
+    write(w);
+    return w.body().mid(4);
+}
+
+// skips the id and type of a hda message so it can be fed to parse<HData> directly
+QByteArray Benchmark::hdataBody(const QByteArray &message) {
+    Protocol::Cursor s(message);
+    Protocol::parse<Protocol::String>(s);
+    char type[4] = { 0 };
+    s.readRaw(type, 3);
+    if (!s.ok() || qstrcmp(type, "hda") != 0)
+        return {};
+    return message.mid(s.position() - message.constData());
+}
+
+void Benchmark::initTestCase() {
+    // FormattedString needs the settings for URL shortening, make sure they're around before measuring anything
+    Lith::instance();
+}
+
+void Benchmark::parseChar() {
+    auto data = payload([](RelayWriter &w) { w.chr('x'); });
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::Char>(s);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::parseInteger() {
+    auto data = payload([](RelayWriter &w) { w.integer(123456); });
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::Integer>(s);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::parseLongInteger() {
+    auto data = payload([](RelayWriter &w) { w.longInteger(1234567890123ll); });
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::LongInteger>(s);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::parseString() {
+    auto data = payload([](RelayWriter &w) { w.string(coloredMessage); });
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::String>(s, true);
+        Q_UNUSED(r);
+    }
+}
+
+// same as above but including the (otherwise deferred) color decoding
+void Benchmark::parseStringDecoded() {
+    auto data = payload([](RelayWriter &w) { w.string(coloredMessage); });
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::String>(s, true);
+        r.count();
+    }
+}
+
+void Benchmark::parseBuffer() {
+    auto data = payload([](RelayWriter &w) { w.buffer(plainMessage); });
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::Buffer>(s);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::parsePointer() {
+    auto data = payload([](RelayWriter &w) { w.pointer(0x55d0c0de2040); });
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::Pointer>(s);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::parseTime() {
+    auto data = payload([](RelayWriter &w) { w.time(1600000000); });
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::Time>(s);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::parseHashTable() {
+    auto data = payload([](RelayWriter &w) {
+        w.hashTable({ { "plugin", "irc" }, { "name", "libera.#lith" }, { "type", "channel" }, { "nick", "somebody" }, { "server", "libera" } });
+    });
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::HashTable>(s);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::parseArrayInt() {
+    auto data = payload([](RelayWriter &w) { w.arrayInt({ 0, 4, 12, 1 }); }).mid(3);
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::ArrayInt>(s);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::parseArrayStr() {
+    auto data = payload([](RelayWriter &w) { w.arrayStr({ "irc_privmsg", "notify_message", "prefix_nick_248", "nick_somebody", "log1" }); }).mid(3);
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::ArrayStr>(s);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::parseHData_data() {
+    QTest::addColumn<QByteArray>("data");
+
+    RelayWriter lines;
+    writeLines(lines, 1000);
+    QTest::newRow("1000 lines") << hdataBody(lines.body());
+
+    RelayWriter buffers;
+    writeBuffers(buffers, 200);
+    QTest::newRow("200 buffers") << hdataBody(buffers.body());
+}
+
+void Benchmark::parseHData() {
+    QFETCH(QByteArray, data);
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::HData>(s);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::parsePipeline() {
+    // a sync's worth of messages, all of them have to come out of the pipeline before an iteration ends
+    QList<QByteArray> messages;
+    for (int i = 0; i < 50; i++) {
+        RelayWriter w("handleFetchLines");
+        writeLines(w, 200);
+        messages.append(w.body());
+    }
+    ParsePipeline pipeline;
+    QSemaphore delivered;
+    pipeline.setSink([&delivered](QList<ParsePipeline::Message> &&batch) {
+        delivered.release(batch.count());
+    });
+    QBENCHMARK {
+        for (const auto &i : messages)
+            pipeline.submit(i);
+        delivered.acquire(messages.count());
+    }
+}
+
+void Benchmark::convertColorsToHtml_data() {
+    QTest::addColumn<QByteArray>("data");
+    QTest::newRow("plain") << plainMessage;
+    QTest::newRow("unicode") << unicodeMessage;
+    QTest::newRow("prefix") << coloredPrefix;
+    QTest::newRow("colors") << coloredMessage;
+    QTest::newRow("url") << urlMessage;
+}
+
+void Benchmark::convertColorsToHtml() {
+    QFETCH(QByteArray, data);
+    QBENCHMARK {
+        auto r = Protocol::convertColorsToHtml(data, true);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::prune() {
+    FormattedString source;
+    source += "text before the links ";
+    source.addPart({ QString::fromUtf8(urlMessage) });
+    source.addPart();
+    source.addPart({ QString::fromUtf8(unicodeMessage) });
+    source.addPart();
+    QBENCHMARK {
+        // includes copying the parts, prune changes the string in place
+        auto r = source;
+        r.prune();
+    }
+}
+
+void Benchmark::toHtml_data() {
+    QTest::addColumn<QByteArray>("data");
+    QTest::newRow("plain") << plainMessage;
+    QTest::newRow("colors") << coloredMessage;
+    QTest::newRow("url") << urlMessage;
+}
+
+void Benchmark::toHtml() {
+    QFETCH(QByteArray, data);
+    auto string = Protocol::convertColorsToHtml(data, true);
+    QBENCHMARK {
+        auto r = string.toHtml(darkTheme);
+        Q_UNUSED(r);
+    }
+}
+
+void Benchmark::toTrimmedHtml_data() {
+    toHtml_data();
+}
+
+void Benchmark::toTrimmedHtml() {
+    QFETCH(QByteArray, data);
+    auto string = Protocol::convertColorsToHtml(data, true);
+    QBENCHMARK {
+        auto r = string.toTrimmedHtml(16, darkTheme);
+        Q_UNUSED(r);
+    }
+}
+
+// per 1000 items, the list is refilled in each iteration so it doesn't grow without bounds
+void Benchmark::qmlObjectListPrepend() {
+    auto list = QmlObjectList::create<Nick>();
+    QBENCHMARK {
+        list->clear();
+        for (int i = 0; i < 1000; i++)
+            list->prepend(new Nick(nullptr));
+    }
+    delete list;
+}
+
+void Benchmark::qmlObjectListPrependBatch() {
+    auto list = QmlObjectList::create<Nick>();
+    QBENCHMARK {
+        list->clear();
+        QList<QObject*> batch;
+        for (int i = 0; i < 1000; i++)
+            batch.append(new Nick(nullptr));
+        list->prepend(batch);
+    }
+    delete list;
+}
+
+void Benchmark::qmlObjectListAppend() {
+    auto list = QmlObjectList::create<Nick>();
+    QBENCHMARK {
+        list->clear();
+        for (int i = 0; i < 1000; i++)
+            list->append(new Nick(nullptr));
+    }
+    delete list;
+}
+
+// per 1000 lines, the model is refilled in each iteration so it doesn't grow without bounds
+void Benchmark::lineModelPrepend() {
+    LineModel model;
+    QBENCHMARK {
+        model.clear();
+        for (int i = 0; i < 1000; i++)
+            model.prepend({ BufferLine() });
+    }
+}
+
+void Benchmark::lineModelPrependBatch() {
+    LineModel model;
+    QBENCHMARK {
+        model.clear();
+        QList<BufferLine> batch(1000);
+        model.prepend(std::move(batch));
+    }
+}
+
+void Benchmark::lineModelAppend() {
+    LineModel model;
+    QBENCHMARK {
+        model.clear();
+        for (int i = 0; i < 1000; i++)
+            model.append(BufferLine());
+    }
+}
+
+// Recorded relay traffic from the directory pointed to by LITH_BENCHMARK_DATA, either capture files
+// made with --record or single decompressed messages, one per file
+void Benchmark::recordedMessages_data() {
+    QTest::addColumn<QByteArray>("data");
+    auto path = qEnvironmentVariable("LITH_BENCHMARK_DATA");
+    if (path.isEmpty())
+        return;
+    QDir dir(path);
+    for (const auto &i : dir.entryInfoList(QDir::Files, QDir::Name)) {
+        Capture::Reader reader;
+        if (i.suffix() == "lithcap" && reader.open(i.filePath())) {
+            Capture::Reader::Record record;
+            for (int n = 0; reader.next(record); n++) {
+                auto body = hdataBody(record.data);
+                if (!body.isEmpty())
+                    QTest::addRow("%s:%d", qPrintable(i.fileName()), n) << body;
+            }
+            continue;
+        }
+        QFile file(i.filePath());
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Can't read" << i.filePath();
+            continue;
+        }
+        auto body = hdataBody(file.readAll());
+        if (!body.isEmpty())
+            QTest::newRow(qPrintable(i.fileName())) << body;
+    }
+}
+
+void Benchmark::recordedMessages() {
+    QFETCH(QByteArray, data);
+    QBENCHMARK {
+        Protocol::Cursor s(data);
+        auto r = Protocol::parse<Protocol::HData>(s);
+        Q_UNUSED(r);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // runs on machines without any display, with its own settings so a configured relay isn't contacted
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QCoreApplication::setOrganizationName("Lith");
+    QCoreApplication::setApplicationName("LithBenchmark");
+    QApplication app(argc, argv);
+
+    // the median of several runs is a lot more stable between runs than a single measurement
+    QStringList args = app.arguments();
+    if (!args.contains("-median"))
+        args << "-median" << "5";
+
+    Benchmark benchmark;
+    return QTest::qExec(&benchmark, args);
+}
+
+#include "benchmark.moc"
@@ -0,0 +1,21 @@
+# Benchmarks of the protocol parsing and formatting code, run them with ./benchmark
+# Recorded messages (one decompressed message per file) are picked up from $LITH_BENCHMARK_DATA
+
+TEMPLATE = app
+TARGET = benchmark
+
+QT += qml quick widgets multimedia quickcontrols2 xml gui-private websockets testlib
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+include(../../src/src.pri)
+include(../common/common.pri)
+
+SOURCES += \
+    benchmark.cpp
+
+DEFINES += IMGUR_API_KEY=\\\"\\\"
+
+linux:!android {
+    QT += dbus
+}
@@ -0,0 +1,8 @@
+HEADERS += \
+    $$PWD/relaywriter.h
+
+SOURCES += \
+    $$PWD/relaywriter.cpp
+
+INCLUDEPATH += \
+    $$PWD
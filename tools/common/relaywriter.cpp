@@ -0,0 +1,101 @@
+#include "relaywriter.h"
+
+#include <QtEndian>
+
+RelayWriter::RelayWriter(const QByteArray &id) {
+    string(id);
+}
+
+RelayWriter &RelayWriter::type(const char *type) {
+    m_data.append(type, 3);
+    return *this;
+}
+
+RelayWriter &RelayWriter::chr(char value) {
+    m_data.append(value);
+    return *this;
+}
+
+RelayWriter &RelayWriter::integer(qint32 value) {
+    char buf[4];
+    qToBigEndian<qint32>(value, buf);
+    m_data.append(buf, 4);
+    return *this;
+}
+
+RelayWriter &RelayWriter::longInteger(qint64 value) {
+    auto text = QByteArray::number(value);
+    m_data.append(char(text.size()));
+    m_data.append(text);
+    return *this;
+}
+
+RelayWriter &RelayWriter::string(const QByteArray &value) {
+    if (value.isNull())
+        return integer(-1);
+    integer(value.size());
+    m_data.append(value);
+    return *this;
+}
+
+RelayWriter &RelayWriter::buffer(const QByteArray &value) {
+    return string(value);
+}
+
+RelayWriter &RelayWriter::pointer(quint64 value) {
+    auto text = QByteArray::number(value, 16);
+    m_data.append(char(text.size()));
+    m_data.append(text);
+    return *this;
+}
+
+RelayWriter &RelayWriter::time(qint64 secsSinceEpoch) {
+    return longInteger(secsSinceEpoch);
+}
+
+RelayWriter &RelayWriter::hashTable(const QMap<QByteArray, QByteArray> &value) {
+    type("str");
+    type("str");
+    integer(value.count());
+    for (auto it = value.cbegin(); it != value.cend(); ++it) {
+        string(it.key());
+        string(it.value());
+    }
+    return *this;
+}
+
+RelayWriter &RelayWriter::arrayInt(const QList<qint32> &value) {
+    type("int");
+    integer(value.count());
+    for (auto i : value)
+        integer(i);
+    return *this;
+}
+
+RelayWriter &RelayWriter::arrayStr(const QList<QByteArray> &value) {
+    type("str");
+    integer(value.count());
+    for (const auto &i : value)
+        string(i);
+    return *this;
+}
+
+RelayWriter &RelayWriter::hdata(const QByteArray &path, const QByteArray &keys, qint32 count) {
+    type("hda");
+    string(path);
+    string(keys);
+    return integer(count);
+}
+
+QByteArray RelayWriter::frame(bool compressed) const {
+    // qCompress prepends the uncompressed size, the relay sends just the zlib stream
+    QByteArray payload = compressed ? qCompress(m_data).mid(4) : m_data;
+    QByteArray result;
+    result.reserve(payload.size() + 5);
+    char length[4];
+    qToBigEndian<quint32>(payload.size() + 5, length);
+    result.append(length, 4);
+    result.append(char(compressed ? 1 : 0));
+    result.append(payload);
+    return result;
+}
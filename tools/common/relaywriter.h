@@ -0,0 +1,37 @@
+#ifndef RELAYWRITER_H
+#define RELAYWRITER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+
+// Builds messages in the WeeChat relay binary protocol, the same format Protocol::parse reads
+class RelayWriter {
+public:
+    // starts a message with the given id, an empty id is what WeeChat sends for unsolicited replies
+    explicit RelayWriter(const QByteArray &id = {});
+
+    RelayWriter &type(const char *type);
+    RelayWriter &chr(char value);
+    RelayWriter &integer(qint32 value);
+    RelayWriter &longInteger(qint64 value);
+    // a null QByteArray is sent as a null string
+    RelayWriter &string(const QByteArray &value);
+    RelayWriter &buffer(const QByteArray &value);
+    RelayWriter &pointer(quint64 value);
+    RelayWriter &time(qint64 secsSinceEpoch);
+    RelayWriter &hashTable(const QMap<QByteArray, QByteArray> &value);
+    RelayWriter &arrayInt(const QList<qint32> &value);
+    RelayWriter &arrayStr(const QList<QByteArray> &value);
+    // writes the type, path, keys and row count, the rows are then written value by value
+    RelayWriter &hdata(const QByteArray &path, const QByteArray &keys, qint32 count);
+
+    const QByteArray &body() const { return m_data; }
+    // prepends the length and compression byte, the result can be sent to the client as is
+    QByteArray frame(bool compressed = false) const;
+
+private:
+    QByteArray m_data;
+};
+
+#endif // RELAYWRITER_H
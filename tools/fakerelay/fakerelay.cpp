@@ -0,0 +1,411 @@
+#include "fakerelay.h"
+#include "relaywriter.h"
+
+#include <QTcpSocket>
+#include <QWebSocket>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QDateTime>
+#include <QDebug>
+
+static constexpr quint64 c_bufferBase = 0x55d000000000;
+static constexpr quint64 c_lineBase = 0x7f0000000000;
+static constexpr quint64 c_nickBase = 0x560000000000;
+static const QByteArray c_ownNick = "lith";
+
+static const QByteArray c_lineKeys = "buffer:ptr,date:tim,date_printed:tim,displayed:chr,notify_level:chr,highlight:chr,tags_array:arr,prefix:str,message:str";
+static const QByteArray c_nickKeys = "group:chr,visible:chr,level:int,name:str,color:str,prefix:str,prefix_color:str";
+
+static const QList<QByteArray> c_words {
+    "the", "relay", "is", "working", "again", "after", "the", "update", "did", "anyone", "try", "compiling", "with", "clang",
+    "lol", "yes", "no", "maybe", "tomorrow", "I", "think", "it's", "a", "bug", "in", "the", "parser", "příliš", "žluťoučký",
+    "kůň", "🐴", "https://github.com/LithApp/Lith", "ok", "thanks", "works", "for", "me", "on", "linux", "and", "ios"
+};
+
+FakeRelay::FakeRelay(const Options &options, QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_lineCounts(options.buffers, options.lines)
+{
+    connect(&m_server, &QTcpServer::newConnection, this, &FakeRelay::onNewConnection);
+    connect(&m_webSocketServer, &QWebSocketServer::newConnection, this, &FakeRelay::onNewWebSocketConnection);
+    connect(&m_timer, &QTimer::timeout, this, &FakeRelay::onTick);
+    m_timer.setInterval(10);
+}
+
+bool FakeRelay::listen(quint16 port) {
+    if (!m_server.listen(QHostAddress::Any, port)) {
+        qCritical() << "Can't listen on port" << port << ":" << m_server.errorString();
+        return false;
+    }
+    qInfo() << "Listening on port" << m_server.serverPort() << "with" << m_options.buffers << "buffers," << m_options.nicks << "nicks and" << m_options.rate << "lines per second";
+    m_elapsed.start();
+    if (m_options.rate > 0)
+        m_timer.start();
+    return true;
+}
+
+void FakeRelay::onNewConnection() {
+    while (m_server.hasPendingConnections()) {
+        auto socket = m_server.nextPendingConnection();
+        auto client = new Client;
+        client->tcpSocket = socket;
+        m_clients.append(client);
+        connect(socket, &QTcpSocket::readyRead, this, [this, client, socket]() {
+            // WebSocket clients start with an HTTP request, they're taken over by the WebSocket server
+            if (!client->authenticated && client->input.isEmpty() && socket->peek(4) == "GET ") {
+                socket->disconnect(this);
+                m_clients.removeOne(client);
+                delete client;
+                m_webSocketServer.handleConnection(socket);
+                return;
+            }
+            onClientData(client, socket->readAll());
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this, client]() {
+            removeClient(client);
+        });
+    }
+}
+
+void FakeRelay::onNewWebSocketConnection() {
+    while (m_webSocketServer.hasPendingConnections()) {
+        auto socket = m_webSocketServer.nextPendingConnection();
+        auto client = new Client;
+        client->webSocket = socket;
+        m_clients.append(client);
+        connect(socket, &QWebSocket::textMessageReceived, this, [this, client](const QString &message) {
+            onClientData(client, message.toUtf8());
+        });
+        connect(socket, &QWebSocket::binaryMessageReceived, this, [this, client](const QByteArray &message) {
+            onClientData(client, message);
+        });
+        connect(socket, &QWebSocket::disconnected, this, [this, client]() {
+            removeClient(client);
+        });
+    }
+}
+
+void FakeRelay::removeClient(Client *client) {
+    if (!m_clients.removeOne(client))
+        return;
+    if (client->tcpSocket)
+        client->tcpSocket->deleteLater();
+    if (client->webSocket)
+        client->webSocket->deleteLater();
+    delete client;
+    qInfo() << "Client disconnected," << m_clients.count() << "left";
+}
+
+void FakeRelay::onClientData(Client *client, const QByteArray &data) {
+    client->input.append(data);
+    while (true) {
+        auto end = client->input.indexOf('\n');
+        if (end < 0)
+            break;
+        auto line = client->input.left(end);
+        client->input.remove(0, end + 1);
+        if (line.endsWith('\r'))
+            line.chop(1);
+        handleCommand(client, line);
+        // the client could have been disconnected by the command
+        if (!m_clients.contains(client))
+            return;
+    }
+}
+
+void FakeRelay::handleCommand(Client *client, const QByteArray &line) {
+    QByteArray id;
+    QByteArray rest = line;
+    if (rest.startsWith('(')) {
+        auto end = rest.indexOf(')');
+        if (end < 0)
+            return;
+        id = rest.mid(1, end - 1);
+        rest = rest.mid(end + 1).trimmed();
+    }
+    auto space = rest.indexOf(' ');
+    auto command = space < 0 ? rest : rest.left(space);
+    auto arguments = space < 0 ? QByteArray() : rest.mid(space + 1);
+
+    // the options are comma separated key=value pairs
+    auto options = [&arguments]() {
+        QMap<QByteArray, QByteArray> result;
+        for (const auto &i : arguments.split(',')) {
+            auto separator = i.indexOf('=');
+            result.insert(i.left(separator).trimmed(), separator < 0 ? QByteArray() : i.mid(separator + 1));
+        }
+        return result;
+    };
+
+    if (command == "handshake") {
+        // zstd isn't supported here, zlib is picked whenever the client offers it
+        client->compressed = options().value("compression").split(':').contains("zlib");
+        RelayWriter w(id);
+        w.type("htb").hashTable({
+            { "password_hash_algo", "plain" },
+            { "password_hash_iterations", "100000" },
+            { "totp", "off" },
+            { "nonce", QByteArray::number(QRandomGenerator::global()->generate64(), 16).rightJustified(16, '0') },
+            { "compression", client->compressed ? "zlib" : "off" },
+        });
+        send(client, w);
+    }
+    else if (command == "init") {
+        auto values = options();
+        if (values.contains("compression"))
+            client->compressed = values.value("compression") == "zlib";
+        if (!m_options.password.isEmpty() && values.value("password") != m_options.password.toUtf8()) {
+            qWarning() << "Client sent a wrong password, disconnecting";
+            if (client->tcpSocket)
+                client->tcpSocket->disconnectFromHost();
+            if (client->webSocket)
+                client->webSocket->close();
+            removeClient(client);
+            return;
+        }
+        client->authenticated = true;
+        qInfo() << "Client authenticated," << m_clients.count() << "connected";
+    }
+    else if (!client->authenticated) {
+        qWarning() << "Ignoring" << command << "from a client that didn't authenticate";
+    }
+    else if (command == "hdata") {
+        handleHData(client, id, arguments);
+    }
+    else if (command == "nicklist") {
+        RelayWriter w(id);
+        w.hdata("buffer/nicklist_item", c_nickKeys, qMax(0, m_options.buffers - 1) * (m_options.nicks + 1));
+        // the first buffer is the server, it has no nicks
+        for (int i = 1; i < m_options.buffers; i++) {
+            w.pointer(bufferPointer(i)).pointer(c_nickBase + (quint64(i) << 20));
+            w.chr(1).chr(0).integer(0).string("root").string({}).string({}).string({});
+            for (int j = 0; j < m_options.nicks; j++) {
+                w.pointer(bufferPointer(i)).pointer(c_nickBase + (quint64(i) << 20) + (j + 1) * 0x40);
+                w.chr(0).chr(1).integer(0).string(nickName(j)).string("default").string(j % 10 == 0 ? "@" : " ").string("lightgreen");
+            }
+        }
+        send(client, w);
+    }
+    else if (command == "sync") {
+        client->synced = true;
+    }
+    else if (command == "desync") {
+        client->synced = false;
+    }
+    else if (command == "ping") {
+        RelayWriter w("_pong");
+        w.type("str").string(arguments);
+        send(client, w);
+    }
+    else if (command == "input") {
+        auto separator = arguments.indexOf(' ');
+        auto buffer = bufferIndex(arguments.left(separator).toULongLong(nullptr, 16));
+        if (buffer >= 0 && separator > 0)
+            sendLine(buffer, c_ownNick, arguments.mid(separator + 1));
+    }
+    else if (command == "quit") {
+        if (client->tcpSocket)
+            client->tcpSocket->disconnectFromHost();
+        if (client->webSocket)
+            client->webSocket->close();
+    }
+    else {
+        qWarning() << "Unhandled command:" << line;
+    }
+}
+
+void FakeRelay::handleHData(Client *client, const QByteArray &id, const QByteArray &arguments) {
+    static const QRegularExpression buffersRe(R"(^buffer:gui_buffers\(\*\)( .*)?$)");
+    static const QRegularExpression linesRe(R"(^buffer:(gui_buffers\(\*\)|0x[0-9a-fA-F]+)/lines/last_line\((-?\d+)\)/data)");
+    static const QRegularExpression pageRe(R"(^line:0x([0-9a-fA-F]+)\((-?\d+)\)/data)");
+    static const QRegularExpression hotlistRe(R"(^hotlist:gui_hotlist\(\*\))");
+
+    auto path = QString::fromUtf8(arguments);
+    RelayWriter w(id);
+    if (auto match = linesRe.match(path); match.hasMatch()) {
+        int first = 0, last = m_options.buffers - 1;
+        if (match.captured(1).startsWith("0x")) {
+            first = last = bufferIndex(match.captured(1).mid(2).toULongLong(nullptr, 16));
+            if (first < 0) {
+                w.hdata("buffer/lines/line/line_data", c_lineKeys, 0);
+                send(client, w);
+                return;
+            }
+        }
+        int count = qAbs(match.captured(2).toInt());
+        int rows = 0;
+        for (int i = first; i <= last; i++)
+            rows += qMin<qint64>(count, m_lineCounts[i]);
+        auto now = QDateTime::currentSecsSinceEpoch();
+        w.hdata("buffer/lines/line/line_data", c_lineKeys, rows);
+        for (int i = first; i <= last; i++) {
+            // newest first, same as WeeChat does with a negative count
+            for (qint64 n = m_lineCounts[i] - 1; n >= 0 && n >= m_lineCounts[i] - count; n--) {
+                auto date = now - (m_lineCounts[i] - n) * 60;
+                auto seed = (qint64(i) << 32) + n;
+                writeLine(w, true, i, n, date, nickName(seed % qMax(1, m_options.nicks)), randomText(seed));
+            }
+        }
+    }
+    else if (auto match = pageRe.match(path); match.hasMatch()) {
+        // walking back from a line, the line itself comes first
+        quint64 lineData = match.captured(1).toULongLong(nullptr, 16) + 0x20;
+        int buffer = lineData >= c_lineBase ? int((lineData - c_lineBase) >> 28) : -1;
+        qint64 number = qint64(((lineData - c_lineBase) & ((quint64(1) << 28) - 1)) / 0x40);
+        if (buffer < 0 || buffer >= m_options.buffers || number >= m_lineCounts[buffer]) {
+            w.hdata("line/line_data", c_lineKeys, 0);
+            send(client, w);
+            return;
+        }
+        int count = qMin<qint64>(qAbs(match.captured(2).toInt()), number + 1);
+        auto now = QDateTime::currentSecsSinceEpoch();
+        w.hdata("line/line_data", c_lineKeys, count);
+        for (qint64 n = number; n > number - count; n--) {
+            auto date = now - (m_lineCounts[buffer] - n) * 60;
+            auto seed = (qint64(buffer) << 32) + n;
+            w.pointer(c_lineBase + (quint64(buffer) << 28) + quint64(n) * 0x40 - 0x20);
+            writeLine(w, false, buffer, n, date, nickName(seed % qMax(1, m_options.nicks)), randomText(seed));
+        }
+    }
+    else if (buffersRe.match(path).hasMatch()) {
+        w.hdata("buffer", "number:int,name:str,short_name:str,hidden:int,title:str,local_variables:htb", m_options.buffers);
+        for (int i = 0; i < m_options.buffers; i++) {
+            auto name = bufferName(i);
+            auto shortName = i == 0 ? QByteArray("libera") : name.mid(name.indexOf('#'));
+            w.pointer(bufferPointer(i))
+             .integer(i + 1)
+             .string(name)
+             .string(shortName)
+             .integer(0)
+             .string(i == 0 ? QByteArray("IRC: irc.libera.chat/6697") : "Welcome to " + shortName + " | \x19" "F05generated\x19" "F00 by fakerelay")
+             .hashTable({
+                 { "plugin", "irc" },
+                 { "name", name.mid(4) },
+                 { "type", i == 0 ? "server" : "channel" },
+                 { "server", "libera" },
+                 { "channel", shortName },
+                 { "nick", c_ownNick },
+             });
+        }
+    }
+    else if (hotlistRe.match(path).hasMatch()) {
+        // a few buffers with some unread activity
+        int count = qMin(m_options.buffers, 5);
+        w.hdata("hotlist", "priority:int,creation_time.tv_sec:tim,creation_time.tv_usec:lon,buffer:ptr,count:arr", count);
+        for (int i = 0; i < count; i++) {
+            w.pointer(c_bufferBase - (i + 1) * 0x100)
+             .integer(i % 4)
+             .time(QDateTime::currentSecsSinceEpoch())
+             .longInteger(0)
+             .pointer(bufferPointer(i))
+             .arrayInt({ 0, i + 1, i % 2, 0 });
+        }
+    }
+    else {
+        qWarning() << "Unhandled hdata request:" << arguments;
+        w.hdata("", "", 0);
+    }
+    send(client, w);
+}
+
+void FakeRelay::send(Client *client, const RelayWriter &message) {
+    auto frame = message.frame(client->compressed);
+    if (client->tcpSocket)
+        client->tcpSocket->write(frame);
+    if (client->webSocket)
+        client->webSocket->sendBinaryMessage(frame);
+}
+
+void FakeRelay::onTick() {
+    if (m_options.buffers <= 1)
+        return;
+    m_owedLines += m_options.rate * m_elapsed.restart() / 1000.0;
+    while (m_owedLines >= 1.0) {
+        m_owedLines -= 1.0;
+        auto rng = QRandomGenerator::global();
+        auto buffer = 1 + int(rng->bounded(m_options.buffers - 1));
+        auto seed = qint64(rng->generate64() >> 1);
+        sendLine(buffer, nickName(seed % qMax(1, m_options.nicks)), randomText(seed));
+    }
+}
+
+void FakeRelay::sendLine(int buffer, const QByteArray &nick, const QByteArray &text) {
+    auto number = m_lineCounts[buffer]++;
+    bool anyoneListening = false;
+    for (auto client : m_clients)
+        anyoneListening |= client->synced;
+    if (!anyoneListening)
+        return;
+
+    RelayWriter w("_buffer_line_added");
+    w.hdata("line_data", c_lineKeys, 1);
+    writeLine(w, false, buffer, number, QDateTime::currentSecsSinceEpoch(), nick, text);
+    for (auto client : m_clients) {
+        if (client->synced)
+            send(client, w);
+    }
+}
+
+void FakeRelay::writeLine(RelayWriter &w, bool fullPath, int buffer, qint64 number, qint64 date, const QByteArray &nick, const QByteArray &text) {
+    quint64 linePointer = c_lineBase + (quint64(buffer) << 28) + quint64(number) * 0x40;
+    bool highlight = nick != c_ownNick && text.contains(c_ownNick);
+    // requested lines come with the whole buffer/lines/line/line_data path, lines added later only have line_data
+    if (fullPath)
+        w.pointer(bufferPointer(buffer)).pointer(bufferPointer(buffer) + 0x10).pointer(linePointer - 0x20);
+    QList<QByteArray> tags { "irc_privmsg", highlight ? "notify_highlight" : "notify_message", "prefix_nick_" + QByteArray::number(nick.size() % 14 + 1), "nick_" + nick, "host_~" + nick + "@example.com", "log1" };
+    if (nick == c_ownNick)
+        tags.insert(1, "self_msg");
+    w.pointer(linePointer)
+     .pointer(bufferPointer(buffer))
+     .time(date)
+     .time(date)
+     .chr(1)
+     .chr(highlight ? 3 : 1)
+     .chr(highlight)
+     .arrayStr(tags)
+     .string("\x19" "F@00" + QByteArray::number(100 + nick.size() * 7).rightJustified(3, '0') + nick)
+     .string(text);
+}
+
+QByteArray FakeRelay::randomText(qint64 seed) const {
+    QRandomGenerator rng(quint32(seed ^ (seed >> 32)));
+    QByteArray result;
+    int words = 3 + rng.bounded(20);
+    for (int i = 0; i < words; i++) {
+        if (!result.isEmpty())
+            result += ' ';
+        auto roll = rng.bounded(100);
+        if (roll < 3)
+            result += c_ownNick;
+        else if (roll < 8)
+            result += "\x19" "F0" + QByteArray::number(1 + rng.bounded(9)) + c_words[rng.bounded(c_words.count())] + "\x1C";
+        else
+            result += c_words[rng.bounded(c_words.count())];
+    }
+    return result;
+}
+
+quint64 FakeRelay::bufferPointer(int buffer) const {
+    return c_bufferBase + quint64(buffer) * 0x1000;
+}
+
+int FakeRelay::bufferIndex(quint64 pointer) const {
+    if (pointer < c_bufferBase || (pointer - c_bufferBase) % 0x1000 != 0)
+        return -1;
+    auto index = (pointer - c_bufferBase) / 0x1000;
+    if (index >= quint64(m_options.buffers))
+        return -1;
+    return int(index);
+}
+
+QByteArray FakeRelay::bufferName(int buffer) const {
+    if (buffer == 0)
+        return "irc.server.libera";
+    return "irc.libera.#channel" + QByteArray::number(buffer);
+}
+
+QByteArray FakeRelay::nickName(int nick) const {
+    static const QList<QByteArray> names { "alice", "bob", "carol", "dave", "eve", "mallory", "trent", "peggy", "victor", "walter" };
+    return names[nick % names.count()] + (nick < names.count() ? QByteArray() : QByteArray::number(nick / names.count()));
+}
@@ -0,0 +1,77 @@
+#ifndef FAKERELAY_H
+#define FAKERELAY_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QWebSocketServer>
+#include <QElapsedTimer>
+#include <QTimer>
+
+class QTcpSocket;
+class QWebSocket;
+class RelayWriter;
+
+// Stand-in for the WeeChat relay plugin, generates buffers, nicks and lines to test the client against.
+// Plain TCP and WebSocket clients are both accepted on the same port, like WeeChat does it. There's no TLS.
+class FakeRelay : public QObject {
+    Q_OBJECT
+public:
+    struct Options {
+        int buffers { 50 };
+        int nicks { 100 };
+        // lines of history available in each buffer
+        int lines { 200 };
+        // new lines per second, spread randomly over all buffers
+        double rate { 10.0 };
+        // any password is accepted when empty
+        QString password;
+    };
+
+    FakeRelay(const Options &options, QObject *parent = nullptr);
+
+    bool listen(quint16 port);
+
+private slots:
+    void onNewConnection();
+    void onNewWebSocketConnection();
+    void onTick();
+
+private:
+    struct Client {
+        QTcpSocket *tcpSocket { nullptr };
+        QWebSocket *webSocket { nullptr };
+        QByteArray input;
+        bool authenticated { false };
+        bool compressed { false };
+        bool synced { false };
+    };
+
+    void onClientData(Client *client, const QByteArray &data);
+    void handleCommand(Client *client, const QByteArray &line);
+    void handleHData(Client *client, const QByteArray &id, const QByteArray &arguments);
+    void send(Client *client, const RelayWriter &message);
+    void removeClient(Client *client);
+
+    quint64 bufferPointer(int buffer) const;
+    int bufferIndex(quint64 pointer) const;
+    QByteArray bufferName(int buffer) const;
+    QByteArray nickName(int nick) const;
+
+    void writeLine(RelayWriter &w, bool fullPath, int buffer, qint64 number, qint64 date, const QByteArray &nick, const QByteArray &text);
+    QByteArray randomText(qint64 seed) const;
+    void sendLine(int buffer, const QByteArray &nick, const QByteArray &text);
+
+    Options m_options;
+    QTcpServer m_server;
+    QWebSocketServer m_webSocketServer { "fakerelay", QWebSocketServer::NonSecureMode };
+    QList<Client *> m_clients;
+
+    // number of lines in every buffer, history included
+    QList<qint64> m_lineCounts;
+
+    QTimer m_timer;
+    QElapsedTimer m_elapsed;
+    double m_owedLines { 0.0 };
+};
+
+#endif // FAKERELAY_H
@@ -0,0 +1,17 @@
+# A stand-in for the WeeChat relay to load test Lith against, see ./fakerelay --help
+
+TEMPLATE = app
+TARGET = fakerelay
+
+QT = core network websockets
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+include(../common/common.pri)
+
+HEADERS += \
+    fakerelay.h
+
+SOURCES += \
+    fakerelay.cpp \
+    main.cpp
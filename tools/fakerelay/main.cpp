@@ -0,0 +1,34 @@
+#include "fakerelay.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("fakerelay");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Pretends to be a WeeChat relay with generated buffers, nicks and messages");
+    parser.addHelpOption();
+    QCommandLineOption portOption("port", "Port to listen on (both plain TCP and WebSocket clients).", "port", "9001");
+    QCommandLineOption buffersOption("buffers", "Number of buffers, including the server buffer.", "count", "50");
+    QCommandLineOption nicksOption("nicks", "Number of nicks in each channel.", "count", "100");
+    QCommandLineOption linesOption("lines", "Number of lines of history in each buffer.", "count", "200");
+    QCommandLineOption rateOption("rate", "New lines per second, spread over all channels.", "lines", "10");
+    QCommandLineOption passwordOption("password", "Password the clients have to use, anything is accepted if not set.", "password");
+    parser.addOptions({ portOption, buffersOption, nicksOption, linesOption, rateOption, passwordOption });
+    parser.process(app);
+
+    FakeRelay::Options options;
+    options.buffers = qMax(1, parser.value(buffersOption).toInt());
+    options.nicks = qMax(0, parser.value(nicksOption).toInt());
+    options.lines = qMax(0, parser.value(linesOption).toInt());
+    options.rate = qMax(0.0, parser.value(rateOption).toDouble());
+    options.password = parser.value(passwordOption);
+
+    FakeRelay relay(options);
+    if (!relay.listen(parser.value(portOption).toUShort()))
+        return 1;
+    return app.exec();
+}
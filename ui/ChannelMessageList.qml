@@ -50,7 +50,7 @@ ListView {
     spacing: lith.settings.messageSpacing
     model: lith.selectedBuffer ? lith.selectedBuffer.lines_filtered : null
     delegate: ChannelMessage {
-        messageModel: modelData
+        messageModel: model
     }
 
     ChannelMessageActionMenu {
@@ -43,9 +43,24 @@ TextField {
 
     onAccepted: {
         if (text.length > 0) {
-            if (lith.selectedBuffer.input(text)) {
+            if (lith.selectedBuffer.input(text))
                 text = ""
-            }
+        }
+    }
+
+    // the buffer keeps what failed to be sent, it comes back once the buffer is open and the field is empty
+    function restoreFailedInput() {
+        var buffer = lith.selectedBuffer
+        if (buffer && buffer.failedInput.length > 0 && text.length === 0) {
+            text = buffer.failedInput
+            buffer.failedInput = ""
+        }
+    }
+
+    Connections {
+        target: lith.selectedBuffer
+        function onFailedInputChanged() {
+            inputField.restoreFailedInput()
         }
     }
 
@@ -53,6 +68,7 @@ TextField {
         target: lith
         function onSelectedBufferChanged() {
             inputField.focus = true
+            inputField.restoreFailedInput()
         }
     }
 
@@ -129,7 +129,7 @@ Dialog {
                     model: modelData.lines
                     delegate: Text {
                         Layout.fillWidth: true
-                        text: modelData.message
+                        text: model.message
                         Rectangle {
                             z: -1
                             anchors {
@@ -154,7 +154,7 @@ Dialog {
                         }
                         MouseArea {
                             anchors.fill: parent
-                            onClicked: viewer.obj = modelData
+                            onClicked: viewer.obj = model
                         }
                     }
                 }
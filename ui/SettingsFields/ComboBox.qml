@@ -0,0 +1,15 @@
+import QtQuick
+import QtQuick.Controls
+import QtQuick.Layouts
+
+Base {
+    id: root
+    property alias model: comboBox.model
+    property alias currentIndex: comboBox.currentIndex
+    property alias currentText: comboBox.currentText
+
+    rowComponent: ComboBox {
+        id: comboBox
+        Layout.maximumWidth: root.width / 2
+    }
+}
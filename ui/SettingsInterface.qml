@@ -46,6 +46,8 @@ ScrollView {
         settings.hotlistCompact = hotlistCompactCheckbox.checked
         settings.hotlistShowUnreadCount = hotlistShowUnreadCountCheckbox.checked
         settings.messageSpacing = messageSpacingSpinbox.value
+        settings.linesPerBuffer = linesPerBufferSpinBox.value
+        settings.linesTotal = linesTotalSpinBox.value
         settings.showJoinPartQuitMessages = showJoinPartQuitMessagesCheckbox.checked
         settings.baseFontFamily = fontDialog.currentFont.family
         settings.showBufferListOnStartup = showBufferListOnStartupCheckbox.checked
@@ -71,6 +73,8 @@ ScrollView {
         hotlistCompactCheckbox.checked = settings.hotlistCompact
         hotlistShowUnreadCountCheckbox.checked = settings.hotlistShowUnreadCount
         messageSpacingSpinbox.value = settings.messageSpacing
+        linesPerBufferSpinBox.value = settings.linesPerBuffer
+        linesTotalSpinBox.value = settings.linesTotal
         showJoinPartQuitMessagesCheckbox.checked = settings.showJoinPartQuitMessages
         try {
             fontChangeButton.text = settings.baseFontFamily
@@ -360,6 +364,25 @@ ScrollView {
                 summary: qsTr("Message spacing")
                 value: settings.messageSpacing
             }
+
+            Fields.IntSpinBox {
+                id: linesPerBufferSpinBox
+                summary: qsTr("Lines kept per buffer")
+                details: qsTr("Older lines are fetched again when scrolling back")
+                value: settings.linesPerBuffer
+                from: 100
+                to: 100000
+                stepSize: 100
+            }
+
+            Fields.IntSpinBox {
+                id: linesTotalSpinBox
+                summary: qsTr("Lines kept in total")
+                value: settings.linesTotal
+                from: 1000
+                to: 1000000
+                stepSize: 1000
+            }
         }
     }
 }
@@ -37,6 +37,7 @@ ScrollView {
         settings.allowSelfSignedCertificates = selfSignedCertificateCheckbox.checked
         settings.handshakeAuth = handshakeAuthCheckbox.checked
         settings.connectionCompression = connectionCompressionCheckbox.checked
+        settings.connectionCompressionCodec = connectionCompressionCodecComboBox.currentText
         if (typeof settings.useWebsockets !== "undefined") {
             settings.useWebsockets = useWebsocketsCheckbox.checked
         }
@@ -52,6 +53,7 @@ ScrollView {
         selfSignedCertificateCheckbox.checked = settings.allowSelfSignedCertificates
         handshakeAuthCheckbox.checked = settings.handshakeAuth
         connectionCompressionCheckbox.checked = settings.connectionCompression
+        connectionCompressionCodecComboBox.currentIndex = Math.max(0, connectionCompressionCodecComboBox.model.indexOf(settings.connectionCompressionCodec))
         if (typeof settings.useWebsockets !== "undefined") {
             useWebsocketsCheckbox.checked = settings.useWebsockets
         }
@@ -122,6 +124,15 @@ ScrollView {
 
                 summary: qsTr("Use WeeChat compression")
             }
+            Fields.ComboBox {
+                id: connectionCompressionCodecComboBox
+                enabled: connectionCompressionCheckbox.checked
+                model: ["zstd", "zlib"]
+                currentIndex: Math.max(0, model.indexOf(settings.connectionCompressionCodec))
+
+                summary: qsTr("Compression algorithm")
+                details: qsTr("(zstd needs the handshake and WeeChat 3.5, zlib is used otherwise)")
+            }
             Fields.Header {
                 text: "Websockets"
             }